@@ -0,0 +1,905 @@
+//============================================================================
+// Name        : benchmark.cpp
+// Author      : Tom Wimmenhove
+// Copyright   : GPL 2
+// Description : Per-node micro-benchmarks
+//============================================================================
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <random>
+
+#include <unistd.h>
+
+#include "nodes.h"
+#include "simd.h"
+
+typedef float signalType;
+
+/* Pulls a block of n frames from every channel the benchmark reads. Returns
+ * the number of samples the node handed out, over all of those channels. */
+typedef std::function<size_t(size_t n)> Step;
+
+struct Benchmark
+{
+	std::string node;
+	std::string params;
+
+	/* Sets up the node, fed blocks of n samples */
+	std::function<Step(size_t n)> make;
+};
+
+struct Result
+{
+	std::string node;
+	std::string params;
+	size_t block;
+	uint64_t samples;
+	double seconds;
+
+	double samplesPerSecond() const { return samples / seconds; }
+	double nsPerSample() const { return seconds * 1e9 / samples; }
+};
+
+/* Reads a channel of a node, counting what it hands out */
+template <typename T>
+Step reader(std::shared_ptr<DataStream<T>> node, int channels = 1)
+{
+	auto dataChannels = std::make_shared<std::vector<DataChannel<T>>>();
+	for (int c = 0; c < channels; c++)
+	{
+		dataChannels->emplace_back(node, c);
+	}
+
+	return [dataChannels] (size_t n)
+	{
+		size_t samples = 0;
+		for (auto& dataChannel: *dataChannels)
+		{
+			samples += dataChannel.getView(n).size();
+		}
+
+		return samples;
+	};
+}
+
+/* The input of the nodes under test. It hands out the same block every time,
+ * so what's measured is the node itself, plus the pull that gets its input.
+ * n is only what it starts out with. */
+template <typename T>
+DataChannel<T> input(size_t n, T value = .5)
+{
+	return DataChannel<T>(std::make_shared<DcSource<T>>(value, n), 0);
+}
+
+std::shared_ptr<std::vector<signalType>> lowPass(size_t taps)
+{
+	return std::make_shared<std::vector<signalType>>(designLowPass<signalType>(taps, .1));
+}
+
+std::vector<Benchmark> benchmarks()
+{
+	typedef signalType T;
+	std::vector<Benchmark> res;
+
+	res.push_back({"DcSource", "", [] (size_t n) { return reader<T>(std::make_shared<DcSource<T>>(.5, n)); }});
+	res.push_back({"IncrementSource", "", [] (size_t n) { return reader<T>(std::make_shared<IncrementSource<T>>(0, n)); }});
+
+	for (auto quality: {std::make_pair(OscillatorQuality::Wavetable, "wavetable"),
+			std::make_pair(OscillatorQuality::Quadrature, "quadrature"),
+			std::make_pair(OscillatorQuality::Polynomial, "polynomial")})
+	{
+		res.push_back({"SineSource", quality.second, [quality] (size_t n)
+		{
+			return reader<T>(std::make_shared<SineSource<T>>(440 / 48000.0, 1, n, quality.first));
+		}});
+	}
+
+	for (size_t partials: {16, 256})
+	{
+		res.push_back({"OscillatorBankSource", "partials=" + std::to_string(partials), [partials] (size_t n)
+		{
+			auto bank = std::make_shared<OscillatorBankSource<T>>(n);
+			for (size_t i = 0; i < partials; i++)
+			{
+				bank->add((i + 1) * 55 / 48000.0, 1.0 / partials, 5 / 48000.0, .1);
+			}
+
+			return reader<T>(bank);
+		}});
+	}
+
+	for (auto color: {std::make_pair(NoiseColor::White, "white"), std::make_pair(NoiseColor::Tpdf, "tpdf"),
+			std::make_pair(NoiseColor::Pink, "pink"), std::make_pair(NoiseColor::Brown, "brown")})
+	{
+		res.push_back({"NoiseSource", color.second, [color] (size_t n)
+		{
+			return reader<T>(std::make_shared<NoiseSource<T>>(1, n, color.first, 1));
+		}});
+	}
+
+	res.push_back({"DataStreamConverter", "int16,scale", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DataStreamConverter<T, int16_t>>(input<int16_t>(n, 1000), fullScale<int16_t>()));
+	}});
+
+	res.push_back({"DataStreamConverter", "int16,function", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DataStreamConverter<T, int16_t>>(input<int16_t>(n, 1000),
+				[] (int16_t x) { return x / 32768.0f; }));
+	}});
+
+	for (size_t taps: {15, 63, 255, 1023, 4095})
+	{
+		res.push_back({"FirFilter", "taps=" + std::to_string(taps), [taps] (size_t n)
+		{
+			return reader<T>(std::make_shared<FirFilter<T>>(input<T>(n), lowPass(taps)));
+		}});
+	}
+
+	res.push_back({"MultirateFirFilter", "taps=63,factor=10", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<MultirateFirFilter<T>>(input<T>(n), lowPass(63), 10));
+	}});
+
+	for (size_t sections: {1, 4, 16})
+	{
+		res.push_back({"BiquadFilter", "sections=" + std::to_string(sections), [sections] (size_t n)
+		{
+			std::vector<BiquadCoefficients<T>> eq;
+			for (size_t i = 0; i < sections; i++)
+			{
+				eq.push_back(biquadPeaking<T>(100.0 * (i + 1) / 48000, 3, 2));
+			}
+
+			return reader<T>(std::make_shared<BiquadFilter<T>>(input<T>(n), eq));
+		}});
+	}
+
+	res.push_back({"Gain", "", [] (size_t n) { return reader<T>(std::make_shared<Gain<T>>(input<T>(n), .5)); }});
+
+	res.push_back({"Pointwise", "clip,gain", [] (size_t n)
+	{
+		return reader<T>(pointwise(input<T>(n), ClipOp<T>{-1, 1}, GainOp<T>{.5}));
+	}});
+
+	for (int channels: {2, 4})
+	{
+		auto params = "channels=" + std::to_string(channels);
+
+		res.push_back({"Splitter", params, [channels] (size_t n)
+		{
+			return reader<T>(std::make_shared<Splitter<T>>(input<T>(n), channels), channels);
+		}});
+
+		res.push_back({"DataDuplicator", params, [channels] (size_t n)
+		{
+			auto source = std::make_shared<DcSource<T>>(.5, n);
+			return reader<T>(std::make_shared<DataDuplicator<T>>(source, channels), channels);
+		}});
+
+		/* Fed interleaved blocks of n frames */
+		res.push_back({"StreamDeinterleaver", params, [channels] (size_t n)
+		{
+			return reader<T>(std::make_shared<StreamDeinterleaver<T>>(input<T>(n * channels), channels), channels);
+		}});
+
+		res.push_back({"Deinterleaver", params, [channels] (size_t n)
+		{
+			return reader<T>(std::make_shared<Deinterleaver<T>>(input<T>(n * channels), 0, channels));
+		}});
+	}
+
+	for (int inputs: {2, 4})
+	{
+		res.push_back({"Mixer", "inputs=" + std::to_string(inputs), [inputs] (size_t n)
+		{
+			std::shared_ptr<DataStream<T>> mixer;
+			if (inputs == 2)
+			{
+				mixer = std::make_shared<Mixer<T>>(std::initializer_list<DataChannel<T>>{input<T>(n), input<T>(n)});
+			}
+			else
+			{
+				mixer = std::make_shared<Mixer<T>>(std::initializer_list<DataChannel<T>>{
+					input<T>(n), input<T>(n), input<T>(n), input<T>(n)});
+			}
+
+			return reader<T>(mixer);
+		}});
+	}
+
+	res.push_back({"Modulator", "inputs=2", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<Modulator<T>>(std::initializer_list<DataChannel<T>>{input<T>(n), input<T>(n)}));
+	}});
+
+	res.push_back({"DelayLine", "delay=6000", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DelayLine<T>>(input<T>(n), 6000));
+	}});
+
+	res.push_back({"DelayLine", "taps=4,feedback", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DelayLine<T>>(input<T>(n),
+				std::vector<DelayTap<T>>{{1500, .5}, {3000, .3}, {4500, .2}, {6000, .1}}, 1, .4));
+	}});
+
+	/* A tap shorter than the block */
+	res.push_back({"DelayLine", "taps=1+6000,feedback", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DelayLine<T>>(input<T>(n),
+				std::vector<DelayTap<T>>{{1, .5}, {6000, .25}}, 1, .3));
+	}});
+
+	/* Pulls blocks of 3 / 4 n to hand out blocks of n, so it can't pass them on as is */
+	res.push_back({"DataBuffer", "len=3/4", [] (size_t n)
+	{
+		return reader<T>(std::make_shared<DataBuffer<T>>(input<T>(n), n * 3 / 4));
+	}});
+
+	return res;
+}
+
+/* Runs a step for at least seconds, after warming it up */
+Result measure(const Benchmark& benchmark, size_t n, double seconds)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Step step = benchmark.make(n);
+
+	for (int i = 0; i < 16; i++)
+	{
+		step(n);
+	}
+
+	uint64_t samples = 0;
+	auto start = Clock::now();
+	std::chrono::duration<double> elapsed(0);
+
+	do
+	{
+		/* Read the clock every so many blocks, not to measure the clock */
+		for (int i = 0; i < 8; i++)
+		{
+			samples += step(n);
+		}
+
+		elapsed = Clock::now() - start;
+	} while (elapsed.count() < seconds);
+
+	return {benchmark.node, benchmark.params, n, samples, elapsed.count()};
+}
+
+/* The instruction sets the kernels can use here, from the scalar code up to best */
+std::vector<SimdIsa> simdIsas(SimdIsa best)
+{
+	if (best == SimdIsa::Neon)
+	{
+		return {SimdIsa::Scalar, SimdIsa::Neon};
+	}
+
+	std::vector<SimdIsa> res;
+	for (auto isa: {SimdIsa::Scalar, SimdIsa::Sse, SimdIsa::Avx2})
+	{
+		if (isa <= best)
+		{
+			res.push_back(isa);
+		}
+	}
+
+	return res;
+}
+
+/* Converts in with every instruction set, at lengths that leave tails of every
+ * size, and compares the results bit for bit with the scalar code's */
+template <typename From, typename To>
+bool checkConversion(const std::string& name, const std::vector<From>& in, double scale,
+		const std::vector<SimdIsa>& isas)
+{
+	std::vector<To> expected(in.size());
+	std::vector<To> out(in.size());
+	convertScalar(in.data(), expected.data(), in.size(), scale);
+
+	bool ok = true;
+	for (auto isa: isas)
+	{
+		simdIsa() = isa;
+
+		for (size_t n: {in.size(), in.size() - 1, in.size() - 7, (size_t) 13, (size_t) 3})
+		{
+			std::fill(out.begin(), out.end(), To());
+			convertSamples(in.data(), out.data(), n, scale);
+
+			if (memcmp(out.data(), expected.data(), n * sizeof(To)) != 0)
+			{
+				std::cerr << name << ": " << simdIsaName(isa) << " differs from scalar, " << n << " samples\n";
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+/* Renders every color of noise with every instruction set, in blocks that
+ * leave partial runs, and compares it bit for bit with the scalar code's */
+bool checkNoise(const std::vector<SimdIsa>& isas)
+{
+	bool ok = true;
+	for (auto color: {std::make_pair(NoiseColor::White, "white"), std::make_pair(NoiseColor::Tpdf, "tpdf"),
+			std::make_pair(NoiseColor::Pink, "pink"), std::make_pair(NoiseColor::Brown, "brown")})
+	{
+		std::vector<float> expected;
+		for (auto isa: isas)
+		{
+			simdIsa() = isa;
+
+			NoiseGenerator<float> noise(42, 1, color.first, .3f);
+			std::vector<float> out(8000);
+			for (size_t i = 0; i < out.size(); i += 1001)
+			{
+				noise.render(out.data() + i, std::min<size_t>(1001, out.size() - i));
+			}
+
+			if (expected.empty())
+			{
+				expected = out;
+			}
+			else if (memcmp(out.data(), expected.data(), out.size() * sizeof(float)) != 0)
+			{
+				std::cerr << color.second << " noise: " << simdIsaName(isa) << " differs from scalar\n";
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+/* Splits 1 to 9 channels into an AudioBlock and interleaves them again with
+ * every instruction set, at lengths that leave tails of every size, and
+ * compares both directions with what they should be, bit for bit */
+template <typename T>
+bool checkInterleave(const std::string& name, const std::vector<SimdIsa>& isas)
+{
+	bool ok = true;
+	for (auto isa: isas)
+	{
+		simdIsa() = isa;
+
+		for (int channels = 1; channels <= 9; channels++)
+		{
+			for (size_t frames: {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 1001})
+			{
+				std::vector<T> in(frames * channels);
+				for (size_t i = 0; i < in.size(); i++)
+				{
+					in[i] = (T) (i + 1);
+				}
+
+				AudioBlock<T> block(channels, frames);
+				block.readInterleaved(in.data(), frames);
+
+				bool same = true;
+				for (int c = 0; c < channels; c++)
+				{
+					for (size_t i = 0; i < frames; i++)
+					{
+						same &= block.channel(c)[i] == in[i * channels + c];
+					}
+				}
+
+				/* One past the end, to catch writes beyond it */
+				std::vector<T> out(in.size() + 1, (T) -1);
+				block.writeInterleaved(out.data());
+
+				if (!same || memcmp(out.data(), in.data(), in.size() * sizeof(T)) != 0 || out.back() != (T) -1)
+				{
+					std::cerr << name << ", " << channels << " channels: " << simdIsaName(isa) << " wrong, "
+							<< frames << " frames\n";
+					ok = false;
+				}
+			}
+		}
+	}
+
+	return ok;
+}
+
+/* Runs a cascade of biquads with every instruction set, in blocks of odd
+ * sizes, and glides two of its sections to new coefficients partway. Compares
+ * it with plain transposed direct form II sample by sample, in double, with
+ * the coefficients moving the same way. The block form adds up in another
+ * order, so what's compared is the error relative to the peak. */
+bool checkBiquads(const std::vector<SimdIsa>& isas)
+{
+	std::vector<BiquadCoefficients<double>> designs = {biquadPeaking<double>(.05, 6, 2),
+			biquadLowShelf<double>(.02, -6, .7), biquadHighPass<double>(.003)};
+	std::vector<std::pair<size_t, BiquadCoefficients<double>>> changes = {{0, biquadPeaking<double>(.1, -4, 1)},
+			{2, biquadHighPass<double>(.01)}};
+	size_t rampFrames = 300;
+	size_t changeAt = 3001;
+	size_t sizes[] = {1, 3, 4, 7, 64, 1023, 5, 2, 999};
+
+	auto toFloat = [] (const BiquadCoefficients<double>& c) {
+		return BiquadCoefficients<float>{(float) c.b0, (float) c.b1, (float) c.b2, (float) c.a1, (float) c.a2};
+	};
+	auto toDouble = [] (const BiquadCoefficients<float>& c) {
+		return BiquadCoefficients<double>{c.b0, c.b1, c.b2, c.a1, c.a2};
+	};
+
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> uniform(-1, 1);
+	std::vector<float> in(12000);
+	for (auto& x: in)
+	{
+		x = uniform(random);
+	}
+
+	/* The reference, with what the float sections really run */
+	struct Section
+	{
+		BiquadCoefficients<double> current, target, step;
+		size_t ramp;
+		double s1, s2;
+	};
+
+	std::vector<Section> sections;
+	for (auto& d: designs)
+	{
+		auto c = toDouble(toFloat(d));
+		sections.push_back({c, c, c, 0, 0, 0});
+	}
+
+	std::vector<double> expected(in.size());
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		if (i == changeAt)
+		{
+			for (auto& change: changes)
+			{
+				Section& s = sections[change.first];
+				s.target = toDouble(toFloat(change.second));
+				s.step = {(s.target.b0 - s.current.b0) / rampFrames, (s.target.b1 - s.current.b1) / rampFrames,
+						(s.target.b2 - s.current.b2) / rampFrames, (s.target.a1 - s.current.a1) / rampFrames,
+						(s.target.a2 - s.current.a2) / rampFrames};
+				s.ramp = rampFrames;
+			}
+		}
+
+		double x = in[i];
+		for (auto& s: sections)
+		{
+			if (s.ramp > 0)
+			{
+				s.current.b0 += s.step.b0;
+				s.current.b1 += s.step.b1;
+				s.current.b2 += s.step.b2;
+				s.current.a1 += s.step.a1;
+				s.current.a2 += s.step.a2;
+
+				if (--s.ramp == 0)
+				{
+					s.current = s.target;
+				}
+			}
+
+			double y = s.current.b0 * x + s.s1;
+			s.s1 = s.current.b1 * x - s.current.a1 * y + s.s2;
+			s.s2 = s.current.b2 * x - s.current.a2 * y;
+			x = y;
+		}
+
+		expected[i] = x;
+	}
+
+	double peak = 0;
+	for (double y: expected)
+	{
+		peak = std::max(peak, std::abs(y));
+	}
+
+	bool ok = true;
+	for (auto isa: isas)
+	{
+		simdIsa() = isa;
+
+		std::vector<BiquadCoefficients<float>> coefficients;
+		for (auto& d: designs)
+		{
+			coefficients.push_back(toFloat(d));
+		}
+
+		BiquadCascade<float> cascade(coefficients, rampFrames);
+		std::vector<float> out(in.size());
+		double error = 0;
+
+		for (size_t i = 0, k = 0; i < in.size(); k++)
+		{
+			if (i == changeAt)
+			{
+				for (auto& change: changes)
+				{
+					cascade.set(change.first, toFloat(change.second));
+				}
+			}
+
+			/* Blocks end at the change, so that it starts where the reference's does */
+			size_t n = std::min(sizes[k % (sizeof(sizes) / sizeof(sizes[0]))], in.size() - i);
+			if (i < changeAt)
+			{
+				n = std::min(n, changeAt - i);
+			}
+
+			cascade.process(in.data() + i, out.data() + i, n);
+			i += n;
+		}
+
+		for (size_t i = 0; i < in.size(); i++)
+		{
+			error = std::max(error, std::abs(out[i] - expected[i]));
+		}
+
+		if (!(error <= 1e-4 * peak))
+		{
+			std::cerr << "biquads: " << simdIsaName(isa) << " off by " << error / peak << " of the peak\n";
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+/* Pulls the impulse response of delay lines with several taps and feedback,
+ * in blocks of odd sizes, some longer than the shortest tap and the ring's
+ * slack, and compares it with the recursion the delay line documents */
+bool checkDelayLines()
+{
+	struct Case
+	{
+		std::vector<DelayTap<float>> taps;
+		float dry;
+		float feedback;
+	};
+
+	std::vector<Case> cases = {
+		{{{0, .5}, {3, .2}, {700, -.4}, {5000, .7}}, .9, .6},
+		{{{1, .5}, {6000, .25}}, 1, .3},
+		{{{3, 1}}, 0, .5},
+		{{{2048, 1}}, 0, .99}};
+	size_t sizes[] = {1, 7, 4096, 333, 5000, 1023, 1024};
+	size_t length = 40000;
+
+	bool ok = true;
+	for (auto& c: cases)
+	{
+		std::vector<float> impulse(length);
+		impulse[0] = 1;
+
+		auto source = std::make_shared<InterleavedVectorSource<float>>(impulse.begin(), 1);
+		DataChannel<float> delayed(std::make_shared<DelayLine<float>>(DataChannel<float>(source, 0),
+				c.taps, c.dry, c.feedback), 0);
+
+		std::vector<float> out;
+		for (size_t k = 0; out.size() < length; k++)
+		{
+			auto view = delayed.getView(std::min(sizes[k % (sizeof(sizes) / sizeof(sizes[0]))], length - out.size()));
+			out.insert(out.end(), view.begin(), view.end());
+		}
+
+		/* w[n] = x[n] + feedback * w[n - longest], y[n] = dry * x[n] + sum of gain * w[n - delay] */
+		size_t longest = 0;
+		for (auto& tap: c.taps)
+		{
+			longest = std::max(longest, tap.delay);
+		}
+
+		std::vector<double> w(length);
+		double error = 0;
+		for (size_t n = 0; n < length; n++)
+		{
+			w[n] = impulse[n] + (n >= longest ? c.feedback * w[n - longest] : 0);
+
+			double y = c.dry * impulse[n];
+			for (auto& tap: c.taps)
+			{
+				y += n >= tap.delay ? tap.gain * w[n - tap.delay] : 0;
+			}
+
+			error = std::max(error, std::abs(y - out[n]));
+		}
+
+		if (!(error <= 1e-5))
+		{
+			std::cerr << "delay line with " << c.taps.size() << " taps, feedback " << c.feedback
+					<< ": off by " << error << '\n';
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+/* Checks that what the FIR filters report as their latency() is where their
+ * impulse responses are centred, for an impulse at every phase of the
+ * multirate filter's decimation. Paths lined up by latency() (see main) would
+ * be off by the difference. */
+bool checkLatencies()
+{
+	struct Case
+	{
+		size_t taps;
+		size_t factor;
+	};
+
+	bool ok = true;
+	for (auto c: {Case{63, 1}, Case{63, 10}, Case{31, 4}, Case{101, 3}})
+	{
+		for (size_t at = 0; at < c.factor; at++)
+		{
+			std::vector<float> impulse(4096);
+			impulse[1000 + at] = 1;
+
+			auto source = std::make_shared<InterleavedVectorSource<float>>(impulse.begin(), 1);
+			std::shared_ptr<DataStream<float>> filter;
+			if (c.factor == 1)
+			{
+				filter = std::make_shared<FirFilter<float>>(DataChannel<float>(source, 0), lowPass(c.taps));
+			}
+			else
+			{
+				filter = std::make_shared<MultirateFirFilter<float>>(DataChannel<float>(source, 0), lowPass(c.taps), c.factor);
+			}
+
+			DataChannel<float> filtered(filter, 0);
+			std::vector<float> out;
+			for (size_t n: {1000, 37, 3059})
+			{
+				auto view = filtered.getView(n);
+				out.insert(out.end(), view.begin(), view.end());
+			}
+
+			double sum = 0, moment = 0;
+			for (size_t n = 0; n < out.size(); n++)
+			{
+				sum += out[n];
+				moment += n * (double) out[n];
+			}
+
+			double centre = moment / sum - (1000 + at);
+			if (!(std::abs(centre - filter->latency()) < .01))
+			{
+				std::cerr << filter->name() << " (taps=" << c.taps << ",factor=" << c.factor << "): latency() is "
+						<< filter->latency() << ", the impulse response is centred at " << centre << '\n';
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+/* Checks that every instruction set gives the same results as the scalar code,
+ * and that the filters give what plain reference loops do */
+bool checkKernels()
+{
+	SimdIsa best = simdIsa();
+	auto isas = simdIsas(best);
+
+	std::mt19937 random(1);
+	size_t n = 4099;
+
+	std::vector<int16_t> i16(n);
+	std::vector<int32_t> i32(n);
+	std::vector<Int24> i24(n);
+	std::vector<float> f(n);
+	std::vector<double> d(n);
+
+	std::uniform_real_distribution<double> uniform(-1.2, 1.2);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t x = random();
+
+		i16[i] = x;
+		i32[i] = x;
+		i24[i] = {{(uint8_t) x, (uint8_t) (x >> 8), (uint8_t) (x >> 16)}};
+		f[i] = uniform(random);
+		d[i] = uniform(random);
+	}
+
+	/* The extremes, and what's out of range, ties and NaN */
+	i16[0] = INT16_MIN;
+	i16[1] = INT16_MAX;
+	i32[0] = INT32_MIN;
+	i32[1] = INT32_MAX;
+
+	double specials[] = {NAN, -NAN, INFINITY, -INFINITY, 1e30, -1e30, .5 / 32768, 1.5 / 32768, -2.5 / 32768};
+	for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); i++)
+	{
+		f[i] = f[n / 2 + i] = f[n - 1 - i] = specials[i];
+		d[i] = d[n / 2 + i] = d[n - 1 - i] = specials[i];
+	}
+
+	bool ok = true;
+	ok &= checkConversion<int16_t, float>("int16 to float", i16, fullScale<int16_t>(), isas);
+	ok &= checkConversion<float, int16_t>("float to int16", f, 32768, isas);
+	ok &= checkConversion<int32_t, float>("int32 to float", i32, fullScale<int32_t>(), isas);
+	ok &= checkConversion<float, int32_t>("float to int32", f, 2147483648.0, isas);
+	ok &= checkConversion<Int24, float>("int24 to float", i24, fullScale<Int24>(), isas);
+	ok &= checkConversion<float, Int24>("float to int24", f, 8388608, isas);
+	ok &= checkConversion<float, double>("float to double", f, .5, isas);
+	ok &= checkConversion<double, float>("double to float", d, 3, isas);
+	ok &= checkConversion<double, int32_t>("double to int32", d, 2147483648.0, isas);
+	ok &= checkNoise(isas);
+	ok &= checkInterleave<float>("float interleaving", isas);
+	ok &= checkInterleave<int16_t>("int16 interleaving", isas);
+	ok &= checkBiquads(isas);
+	ok &= checkDelayLines();
+	ok &= checkLatencies();
+
+	simdIsa() = best;
+
+	return ok;
+}
+
+void writeCsv(std::ostream& out, const std::vector<Result>& results)
+{
+	out << "node,params,block,samples,seconds,samples_per_sec,ns_per_sample\n";
+
+	for (auto& r: results)
+	{
+		out << r.node << ",\"" << r.params << "\"," << r.block << ',' << r.samples << ','
+				<< r.seconds << ',' << r.samplesPerSecond() << ',' << r.nsPerSample() << '\n';
+	}
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results)
+{
+	out << "{\n  \"isa\": \"" << simdIsaName(simdIsa()) << "\",\n  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		auto& r = results[i];
+		out << "    {\"node\": \"" << r.node << "\", \"params\": \"" << r.params
+				<< "\", \"block\": " << r.block << ", \"samples\": " << r.samples
+				<< ", \"seconds\": " << r.seconds << ", \"samples_per_sec\": " << r.samplesPerSecond()
+				<< ", \"ns_per_sample\": " << r.nsPerSample() << '}'
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	out << "  ]\n}\n";
+}
+
+void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [-t seconds] [-b block,...] [-i isa] [-f csv|json] [-o file] [-c] [node]\n"
+			"  -t seconds  time per node and block size (default: 0.2)\n"
+			"  -b block    block sizes to run (default: 64,256,1024,4096)\n"
+			"  -i isa      kernels to use: scalar, sse, avx2 or neon (default: the best there is)\n"
+			"  -f format   csv (default) or json\n"
+			"  -o file     where to write the results (default: stdout)\n"
+			"  -c          check that the kernels of every instruction set up to isa give\n"
+			"              the same results as the scalar code, and the filters what plain\n"
+			"              reference loops do, instead of benchmarking\n"
+			"  node        only run the nodes whose name contains this\n";
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = .2;
+	std::vector<size_t> blocks = {64, 256, 1024, 4096};
+	std::string format = "csv";
+	std::string outputName;
+	std::string filter;
+	bool check = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:b:i:f:o:ch")) != -1)
+	{
+		switch (opt)
+		{
+		case 't': seconds = atof(optarg); break;
+		case 'f': format = optarg; break;
+		case 'o': outputName = optarg; break;
+		case 'c': check = true; break;
+		case 'b':
+		{
+			blocks.clear();
+			for (char* p = optarg; *p; p += *p == ',')
+			{
+				blocks.push_back(strtoul(p, &p, 10));
+			}
+			break;
+		}
+		case 'i':
+		{
+			std::string isa = optarg;
+			for (auto x: {SimdIsa::Scalar, SimdIsa::Sse, SimdIsa::Avx2, SimdIsa::Neon})
+			{
+				if (isa == simdIsaName(x))
+				{
+					simdIsa() = x;
+				}
+			}
+			if (isa != simdIsaName(simdIsa()))
+			{
+				std::cerr << "Unknown instruction set: " << isa << '\n';
+				return 1;
+			}
+			break;
+		}
+		default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind < argc)
+	{
+		filter = argv[optind];
+	}
+
+	if (check)
+	{
+		bool ok = checkKernels();
+		std::cerr << (ok ? "Every instruction set matches the scalar code and the references\n" : "Kernels differ\n");
+
+		return ok ? 0 : 1;
+	}
+
+	if (format != "csv" && format != "json")
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<Result> results;
+	for (auto& benchmark: benchmarks())
+	{
+		if (benchmark.node.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		for (size_t n: blocks)
+		{
+			results.push_back(measure(benchmark, n, seconds));
+
+			auto& r = results.back();
+			std::cerr << r.node << (r.params.empty() ? "" : " (" + r.params + ")") << ", " << n << ": "
+					<< r.samplesPerSecond() / 1e6 << " Msamples/s, " << r.nsPerSample() << " ns/sample\n";
+		}
+	}
+
+	std::ofstream file;
+	if (!outputName.empty())
+	{
+		file.open(outputName);
+		if (!file)
+		{
+			std::cerr << "Can't open " << outputName << '\n';
+			return 1;
+		}
+	}
+
+	std::ostream& out = outputName.empty() ? std::cout : file;
+
+	if (format == "json")
+	{
+		writeJson(out, results);
+	}
+	else
+	{
+		writeCsv(out, results);
+	}
+
+	return 0;
+}
@@ -20,796 +20,403 @@
 #include <iterator>
 #include <fstream>
 #include <map>
+#include <deque>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <signal.h>
 
 #include "alsa.h"
+#include "output.h"
+#include "nodes.h"
+#include "graph.h"
+#include "deadline.h"
 
-int numOfHeapAllocations = 0;
-
+/* Counted for the profile report (see profile.h), silently: printing
+ * from here would allocate, and take a lock, in the audio path */
 void* operator new(size_t size)
 {
-    numOfHeapAllocations++;
-
-	std::cout << "Heap allocation #" << numOfHeapAllocations << " of size " << size << '\n';
+	countAllocation();
 
     return malloc(size);
 }
 
-typedef float signalType;
-
-template <typename T>
-class DataStream
+/* The other half of the above */
+void operator delete(void* p) noexcept
 {
-public:
-	virtual const std::vector<T>& getData(int channel) = 0;
-
-	virtual ~DataStream() { }
-};
+	free(p);
+}
 
-template <typename T>
-struct DataChannel
+void operator delete(void* p, size_t size) noexcept
 {
-	std::shared_ptr<DataStream<T>> stream;
-	int channel;
-};
+	free(p);
+}
+
+typedef float signalType;
 
 template <typename T>
-class SharedPool
+std::vector<DataChannel<T>*> pointersTo(std::vector<DataChannel<T>>& dataChannels)
 {
-public:
-	T get()
-	{
-		if (pool.empty())
-		{
-			std::cout << "Allocating new element for pool\n";
-			return T();
-		}
-
-		auto res = std::move(pool.back());
-		pool.pop_back();
-
-		return res;
-	}
-
-	void giveBack(T&& x)
+	std::vector<DataChannel<T>*> res;
+	for (auto& dataChannel: dataChannels)
 	{
-		pool.emplace_back(std::move(x));
+		res.push_back(&dataChannel);
 	}
 
-private:
-	std::vector<T> pool;
-};
+	return res;
+}
 
+/* Pulls blocks of frames frames from the graph and writes them to an Output:
+ * by default, blocks of the output's period. With a pool, the channels are
+ * computed in parallel as far as they are independent of each other. */
 template <typename T>
-class DumbSource: public DataStream<T>
+class Sink
 {
 public:
-	DumbSource(std::initializer_list<T> values)
-		: buffer(values)
-	{ }
+	static constexpr size_t defaultFrames = 1024;
 
-	const std::vector<T>& getData(int channel) override
+	Sink(std::vector<DataChannel<T>> dataChannels, std::unique_ptr<Output<T>> out,
+			std::shared_ptr<ThreadPool> pool = nullptr, size_t frames = 0)
+		: dataChannels(std::move(dataChannels)), out(std::move(out)),
+		  scheduler(pointersTo(this->dataChannels), pool),
+		  views(this->dataChannels.size()), planes(this->dataChannels.size()),
+		  frames(frames ? frames : this->out->period() ? this->out->period() : defaultFrames),
+		  monitor(this->out->sampleRate())
 	{
-		return buffer;
+		if ((int) this->dataChannels.size() != this->out->numChannels())
+		{
+			throw std::invalid_argument("Sink: number of channels doesn't match the output");
+		}
 	}
 
-private:
-	std::vector<T> buffer;
-};
+	/* Something to run before every block is pulled, with the block's size:
+	 * typically the graph's run(). It's timed as part of the block. */
+	void setCycle(std::function<void(size_t)> cycle) { this->cycle = cycle; }
 
-template <typename T>
-class FileReaderSoure : public DataStream<T>
-{
-public:
-	FileReaderSoure(std::string filename, size_t n = 1024)
-		: n(n), buf(n)
+	/* Writes the next block, or only maxFrames frames if that's less. Returns
+	 * the number of frames written, 0 if the output failed. */
+	size_t run(size_t maxFrames = SIZE_MAX)
 	{
-		file = std::ifstream(filename, std::ios::binary);
-	}
+		size_t n = std::min(frames, maxFrames);
 
-	const std::vector<T>& getData(int channel) override
-	{
-		buf.resize(n);
-		size_t byteSize = n * sizeof(T);
+		DeadlineMonitor::Cycle timing(monitor);
+		{
+			AllocationFreeScope scope;
+
+			if (cycle)
+			{
+				cycle(n);
+			}
 
-		file.read((char *) buf.data(), byteSize);
+			scheduler.pull(views.data(), n);
+		}
 
-		size_t cnt = file.gcount();
+		timing.done(n);
 
-		if (cnt < byteSize)
+		for (size_t c = 0; c < views.size(); c++)
 		{
-			buf.resize(cnt / sizeof(T));
+			planes[c] = views[c].data();
 		}
 
-		return buf;
+		return out->write(planes.data(), n) ? n : 0;
 	}
 
-private:
-	size_t n;
-	std::vector<T> buf;
-	std::ifstream file;
-};
+	Output<T>& output() { return *out; }
 
-template <typename T, typename U>
-class DataStreamConverter: public DataStream<T>
-{
-public:
-	DataStreamConverter(std::shared_ptr<DataStream<U>> dataStream, std::function<T(U)> converter)
-		: dataStream(dataStream), converter(converter)
-	{ }
+	size_t blockFrames() const { return frames; }
 
-	const std::vector<T>& getData(int channel) override
-	{
-		buf.clear();
-		auto& data = dataStream->getData(channel);
+	/* How long pulling a block took, against how long it plays */
+	const DeadlineMonitor& deadlines() const { return monitor; }
 
-		for(auto& x: data)
+	std::vector<Node::Input> inputs() const
+	{
+		std::vector<Node::Input> res;
+		for (auto& dataChannel: dataChannels)
 		{
-			buf.push_back(converter(x));
+			res.push_back(dataChannel.input());
 		}
 
-		return buf;
+		return res;
 	}
 
 private:
-	std::vector<T> buf;
-	std::shared_ptr<DataStream<U>> dataStream;
-	std::function<T(U)> converter;
+	std::vector<DataChannel<T>> dataChannels;
+	std::unique_ptr<Output<T>> out;
+	BranchScheduler<T> scheduler;
+	std::vector<DataView<T>> views;
+	std::vector<const T*> planes;
+	size_t frames;
+	std::function<void(size_t)> cycle;
+	DeadlineMonitor monitor;
 };
 
 template <typename T>
-class DcSource: public DataStream<T>
+class AlsaMonoSink : public Sink<T>
 {
 public:
-	DcSource(T dcValue, size_t n = 1024)
-		: dcValue(dcValue), buffer(n, dcValue)
+	AlsaMonoSink(const DataChannel<T>& dataChannel,
+			const std::string& device = "default", const AlsaConfig& config = AlsaConfig())
+		: Sink<T>({dataChannel}, std::make_unique<Alsa<T>>(1, config, device))
 	{ }
-
-	const std::vector<T>& getData(int channel) override { return buffer; }
-
-private:
-	T dcValue;
-	std::vector<T> buffer;
 };
 
 template <typename T>
-class InterleavedVectorSource: public DataStream<T>
+class AlsaStereoSink : public Sink<T>
 {
 public:
-	InterleavedVectorSource(typename std::vector<T>::iterator it,
-			size_t space, size_t n = 1024)
-	: it(it), buf(n), space(space), n(n)
+	/* With a pool, the left and right branches are computed in parallel
+	 * as far as they are independent of each other */
+	AlsaStereoSink(const DataChannel<T>& dataChannelLeft, const DataChannel<T>& dataChannelRight,
+			std::shared_ptr<ThreadPool> pool = nullptr,
+			const std::string& device = "default", const AlsaConfig& config = AlsaConfig())
+		: Sink<T>({dataChannelLeft, dataChannelRight}, std::make_unique<Alsa<T>>(2, config, device), pool)
 	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		for(size_t i = 0; i < buf.size(); i++)
-		{
-			buf[i] = *it;
-			it += space;
-		}
-
-		return buf;
-	}
-
-private:
-	typename std::vector<T>::iterator it;
-	std::vector<T> buf;
-	size_t space;
-	size_t n;
 };
 
-template <typename T>
-class SineSource: public DataStream<T>
+struct RenderStats
 {
-public:
-	SineSource(double rate, T amplitude = 1.0, size_t n = 1024)
-		: inc(rate * M_PI * 2), amplitude(amplitude),  buf(n), x(0)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		for(size_t i = 0; i < buf.size(); i++)
-		{
-			buf[i] = sin(x) * amplitude;
-			x += inc;
-
-			if (x > M_PI * 2)
-			{
-				x -= M_PI * 2;
-			}
-		}
-
-		return buf;
-	}
+	size_t frames;
+	int channels;
+	double audioSeconds;
+	double wallSeconds;
 
-private:
-	double inc;
-	T amplitude;
-	std::vector<T> buf;
-	T x;
+	double samplesPerSecond() const { return frames * channels / wallSeconds; }
+	double realtimeFactor() const { return audioSeconds / wallSeconds; }
 };
 
+/* Runs the graph into sink as fast as it goes, until seconds of audio are
+ * written (or the output fails). The graph becomes the sink's cycle, so that
+ * the sink's deadlines() time all of it. */
 template <typename T>
-class NoiseSource: public DataStream<T>
+RenderStats renderOffline(Graph& graph, Sink<T>& sink, double seconds)
 {
-public:
-	NoiseSource(T amplitude = 1.0, size_t n = 1024)
-		: amplitude(amplitude), buf(n)
-	{
-		std::random_device rd;
-	    rnd = std::default_random_engine(rd());
-	    distr = std::uniform_real_distribution<T>(-amplitude, amplitude);
-	}
+	int rate = sink.output().sampleRate();
+	size_t total = std::llround(seconds * rate);
+	size_t frames = 0;
 
-	const std::vector<T>& getData(int channel) override
-	{
-		for(size_t i = 0; i < buf.size(); i++)
-		{
-			buf[i] = distr(rnd);
-		}
+	sink.setCycle([&graph] (size_t frames) { graph.run(frames); });
 
-		return buf;
-	}
-
-private:
-	T amplitude;
-	std::vector<T> buf;
-	std::uniform_real_distribution<T> distr;
-	std::default_random_engine rnd;
-};
+	auto start = std::chrono::steady_clock::now();
 
-template <typename T>
-class IncrementSource: public DataStream<T>
-{
-public:
-	IncrementSource(T start = 0, size_t n = 1024)
-		: c(start), buf(n)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
+	while (frames < total)
 	{
-		for(size_t i = 0; i < buf.size(); i++)
+		size_t n = sink.run(total - frames);
+		if (n == 0)
 		{
-			buf[i] = c++;
+			break;
 		}
 
-		return buf;
+		frames += n;
 	}
 
-private:
-	T c;
-	std::vector<T> buf;
-};
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
 
+	return { frames, sink.output().numChannels(), (double) frames / rate, wall.count() };
+}
+
+/* Output through mmap'ed ALSA, with the graph decoupled from the device.
+ *
+ * A render thread of its own pulls the graph into period-sized buffers, two
+ * of them, and run() copies the ready ones into the ring as the device makes
+ * room. A late block now only eats into the ring's headroom instead of
+ * stalling the device right away, and when it does cause an xrun, it's
+ * counted. cycle, if given, runs on the render thread before every pull,
+ * with the period: that's where the Graph runs. Call stop() before whatever
+ * cycle uses goes away.
+ *
+ * Every pull asks the graph for exactly one period, whatever the device
+ * settled on. */
 template <typename T>
-class DataDuplicator : public DataStream<T>
+class AsyncAlsaSink
 {
 public:
-	DataDuplicator(std::shared_ptr<DataStream<T>> dataStream, int channels)
-		: dataStream(dataStream), channels(channels), curChannel(0)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		if (channel == 0)
+	AsyncAlsaSink(std::vector<DataChannel<T>> channels, std::unique_ptr<AlsaMmap<T>> device,
+			std::shared_ptr<ThreadPool> pool = nullptr)
+		: channels(std::move(channels)),
+		  scheduler(checked(this->channels), pool),
+		  alsa(std::move(device)),
+		  views(this->channels.size()), monitor(alsa->sampleRate()),
+		  next(0), stopping(false), numLate(0)
+	{
+		if ((int) this->channels.size() != alsa->numChannels())
 		{
-			buf.clear();
-			auto& data = dataStream->getData(channel);
-			buf.insert(buf.end(), data.begin(), data.end());
+			throw std::invalid_argument("AsyncAlsaSink: number of channels doesn't match the device");
 		}
 
-		if (++channel >= channels)
+		for (auto& slot: slots)
 		{
-			channel = 0;
+			slot.block = AudioBlock<T>(this->channels.size(), alsa->period());
+			slot.block.setFrames(alsa->period());
+			slot.ready = false;
 		}
 	}
 
-private:
-	std::vector<T> buf;
-	std::shared_ptr<DataStream<T>> dataStream;
-	int channels;
-	int curChannel;
-};
-
-template <typename T>
-class Deinterleaver : public DataStream<T>
-{
-public:
-	Deinterleaver(const DataChannel<T>& dataChannel, size_t start, size_t inc)
-		: dataChannel(dataChannel), start(start), inc(inc)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
+	~AsyncAlsaSink()
 	{
-		auto& data = dataChannel.stream->getData(dataChannel.channel);
-
-		buf.clear();
-		for (size_t i = start; i < data.size(); i += inc)
-		{
-			buf.push_back(data[i]);
-		}
-
-		return buf;
+		stop();
 	}
 
-private:
-	std::vector<T> buf;
-	DataChannel<T> dataChannel;
-	size_t start;
-	size_t inc;
-};
-
-template <typename T>
-class Splitter : public DataStream<T>
-{
-public:
-	Splitter(const DataChannel<T>& dataChannel, int channels)
-		: dataChannel(dataChannel),
-		  channelPositions(channels), channels(channels)
-	{ }
+	void start(std::function<void(size_t)> cycle = nullptr)
+	{
+		this->cycle = cycle;
+		renderThread = std::thread([this] { renderLoop(); });
+	}
 
-	const std::vector<T>& getData(int channel) override
+	void stop()
 	{
-		size_t minPos = *std::min_element(channelPositions.begin(), channelPositions.end());
-		if (minPos > 0)
 		{
-			for (int i = 0; i < channels; i++)
-			{
-				channelPositions[i]--;
-			}
-
-			pool.giveBack(std::move(bufs.front()));
-			//bufs.pop_front();
-			bufs.erase(bufs.begin());
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
 		}
+		changed.notify_all();
 
-		size_t channelPos = channelPositions[channel]++;
-
-		if (channelPos >= bufs.size())
+		if (renderThread.joinable())
 		{
-			auto& data = dataChannel.stream->getData(dataChannel.channel);
-
-			bufs.push_back(std::move(getNewVector(data)));
+			renderThread.join();
 		}
-
-		return bufs[channelPos];
 	}
 
-private:
-	std::vector<T> getNewVector(const std::vector<T>& original)
-	{
-		auto newVector = pool.get();
-		newVector.clear();
-		newVector.insert(newVector.end(), original.begin(), original.end());
-
-		return newVector;
-	}
-
-	//std::deque<std::vector<T>> bufs;
-	std::vector<std::vector<T>> bufs;
-	DataChannel<T> dataChannel;
-	std::vector<size_t> channelPositions;
-	int channels;
-	SharedPool<std::vector<T>> pool;
-};
-
-template <typename T>
-class StreamDeinterleaver : public DataStream<T>
-{
-public:
-	StreamDeinterleaver(const DataChannel<T>& dataChannel, int channels)
-		: dataChannel(dataChannel), bufqueues(channels), bufs(channels)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
+	/* Plays the next period. Returns false once the device failed. */
+	bool run()
 	{
-		auto& queue = bufqueues[channel];
-
-		if (queue.empty())
+		Slot& slot = slots[next];
 		{
-			auto& data = dataChannel.stream->getData(dataChannel.channel);
-
-			for (size_t i = 0; i < bufqueues.size(); i++)
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!slot.ready && alsa->running())
 			{
-				auto newVector = pool.get();
-				newVector.clear();
-
-				for (size_t j = i; j < data.size(); j += bufqueues.size())
-				{
-					newVector.push_back(data[j]);
-				}
-
-				bufqueues[i].push_back(std::move(newVector));
+				numLate++;
 			}
+			changed.wait(lock, [&slot] { return slot.ready; });
 		}
 
-		pool.giveBack(std::move(bufs[channel]));
+		bool ok = alsa->write(slot.block.planes(), slot.block.frames());
 
-		bufs[channel] = std::move(queue.front());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.ready = false;
+		}
+		changed.notify_all();
 
-		//queue.pop_front();
-		queue.erase(queue.begin());
+		next = (next + 1) % numSlots;
 
-		return bufs[channel];
+		return ok;
 	}
 
-private:
-	DataChannel<T> dataChannel;
-	//std::vector<std::deque<std::vector<T>>> bufqueues;
-	std::vector<std::vector<std::vector<T>>> bufqueues;
-	std::vector<std::vector<T>> bufs;
-	SharedPool<std::vector<T>> pool;
-};
+	/* Device underruns, successful recoveries and periods the render thread
+	 * didn't have ready in time */
+	uint64_t xruns() const { return alsa->xruns(); }
+	uint64_t recoveries() const { return alsa->recoveries(); }
+	uint64_t late() const { return numLate; }
 
-template <typename T>
-class Chopper : public DataStream<T>
-{
-public:
-	Chopper(const DataChannel<T>& dataChannel,
-			double onTime, double offTime)
-		: dataChannel(dataChannel), t(0), onTime(onTime), period(onTime + offTime)
-	{ }
+	/* How long rendering a period took, against how long it plays */
+	const DeadlineMonitor& deadlines() const { return monitor; }
 
-	const std::vector<T>& getData(int channel) override
-	{
-		auto& data = dataChannel.stream->getData(dataChannel.channel);
+	size_t period() const { return alsa->period(); }
 
-		buf.clear();
-		for(auto& x: data)
+	std::vector<Node::Input> inputs() const
+	{
+		std::vector<Node::Input> res;
+		for (auto& channel: channels)
 		{
-			buf.push_back(t <= onTime ? x : 0);
-
-			t++;
-
-			if (t > period)
-			{
-				t -= period;
-			}
+			res.push_back(channel.input());
 		}
 
-		return buf;
-	}
-
-private:
-	std::vector<T> buf;
-	DataChannel<T> dataChannel;
-	double t;
-	double onTime;
-	double period;
-};
-
-template <typename T>
-class Transformer : public DataStream<T>
-{
-public:
-	Transformer(const DataChannel<T>& dataChannel)
-		: dataChannel(dataChannel)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		auto& data = dataChannel.stream->getData(dataChannel.channel);
-
-		buf.resize(data.size());
-
-		std::transform(data.begin(), data.end(), buf.begin(),
-				std::bind(&Transformer::transform, this, std::placeholders::_1));
-
-		return buf;
+		return res;
 	}
 
-protected:
-	virtual T transform(T x) = 0;
-
-private:
-	std::vector<T> buf;
-	DataChannel<T> dataChannel;
-};
-
-template <typename T>
-class Gain : public Transformer<T>
-{
-public:
-	Gain(const DataChannel<T>& dataChannel, T gain)
-		: Transformer<T>(dataChannel), gain(gain)
-	{ }
-
-	void setGain(T gain) { this->gain = gain; }
-	T getGain(T gain) const { return gain; }
-
-protected:
-	T transform(T x) override { return gain * x; }
-
 private:
-	T gain;
-};
-
-template <typename T>
-class Adder : public Transformer<T>
-{
-public:
-	Adder(const DataChannel<T>& dataChannel, T offset)
-		: Transformer<T>(dataChannel), offset(offset)
-	{ }
-
-	void setOffset(T offset) { this->offset = offset; }
-	T getOffset(T offset) const { return offset; }
-
-protected:
-	T transform(T x) override { return offset + x; }
-
-private:
-	T offset;
-};
-
-template <typename T>
-class Clip : public Transformer<T>
-{
-public:
-	Clip(const DataChannel<T>& dataChannel, T lower, T upper)
-		: Transformer<T>(dataChannel), lower(lower), upper(upper)
-	{ }
-
-	void setLower(T lower) { this->lower = lower; }
-	T getLower(T gain) const { return lower; }
-
-	void setUpper(T upper) { this->gain = upper; }
-	T getUpper(T upper) const { return upper; }
+	static constexpr size_t numSlots = 2;
+	static constexpr size_t maxChannels = 32;
 
-protected:
-	T transform(T x) override
+	struct Slot
 	{
-		if (x < lower) x = lower;
-		if (x > upper) x = upper;
-		return x;
-	}
-
-private:
-	T lower;
-	T upper;
-};
-
+		AudioBlock<T> block;
+		bool ready;
+	};
 
-template <typename T>
-class FirFilter : public DataStream<T>
-{
-public:
-	FirFilter(const DataChannel<T>& dataChannel,
-			std::shared_ptr<std::vector<T>> coefficients)
-		: dataChannel(dataChannel), coefficients(coefficients),
-		  buf(coefficients->size() / 2),
-		  taps(coefficients->size()), curTap(taps.end() - 1)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
+	static std::vector<DataChannel<T>*> checked(std::vector<DataChannel<T>>& channels)
 	{
-		auto& data = dataChannel.stream->getData(dataChannel.channel);
-
-		/* Clear the buffer, unless it's the first run (in which
-		 * case the buffer contains nDelay number of silent samples) */
-		if (filled || curTap != taps.end() - 1)
+		if (channels.empty() || channels.size() > maxChannels)
 		{
-			buf.clear();
+			throw std::invalid_argument("AsyncAlsaSink needs 1 to 32 channels");
 		}
 
-		for(auto& x: data)
-		{
-			*curTap = x;
-
-			typename std::vector<T>::iterator tap = curTap;
-			if (curTap-- == taps.begin())
-			{
-				curTap = taps.end();
-				filled = true;
-			}
+		return pointersTo(channels);
+	}
 
-			if (filled)
+	void renderLoop()
+	{
+		for (size_t s = 0; ; s = (s + 1) % numSlots)
+		{
+			Slot& slot = slots[s];
 			{
-				T sum = 0;
-
-				for (typename std::vector<T>::iterator coeff = coefficients->begin();
-					coeff != coefficients->end(); ++coeff, ++tap)
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [this, &slot] { return stopping || !slot.ready; });
+				if (stopping)
 				{
-					if (tap == taps.end())
-					{
-						tap = taps.begin();
-					}
-					sum += (*coeff) * (*tap);
+					return;
 				}
-
-				buf.push_back(sum);
 			}
-		}
 
-		return buf;
-	}
-
-private:
-	DataChannel<T> dataChannel;
-	std::shared_ptr<std::vector<T>> coefficients;
-	std::vector<T> buf;
-	std::vector<T> taps;
-	typename std::vector<T>::iterator curTap;
-	int filled;
-};
-
-template <typename T, typename U>
-class Combiner : public DataStream<T>
-{
-public:
-	Combiner(std::initializer_list<DataChannel<T>> dataChannels,
-			U combiner = U())
-		: dataChannels(dataChannels), combiner(combiner)
-	{ }
+			render(slot);
 
-	const std::vector<T>& getData(int channel) override
-	{
-		buf.clear();
-
-		if (dataChannels.size() == 0)
-		{
-			buf.resize(1024);
-
-			return buf;
-		}
-
-		auto& data0 = dataChannels[0].stream->getData(dataChannels[0].channel);
-
-		buf.insert(buf.end(), data0.begin(), data0.end());
-
-		for(auto it = dataChannels.begin() + 1; it < dataChannels.end(); it++)
-		{
-			auto& data = it->stream->getData(it->channel);
-			if (data0.size() != data.size())
 			{
-				std::cerr << "Size mismatch!\n";
-				return buf;
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.ready = true;
 			}
-
-			std::transform(data.begin(), data.end(), buf.begin(),
-					buf.begin(), combiner);
+			changed.notify_all();
 		}
-
-		return buf;
-	}
-
-	size_t numStreams() const { return dataChannels.size(); }
-
-private:
-	std::vector<T> buf;
-	std::vector<DataChannel<T>> dataChannels;
-	U combiner;
-};
-
-template <typename T>
-struct Mixer : public Combiner<T, std::plus<T>>
-{
-	using Combiner<T, std::plus<T>>::Combiner;
-};
-
-template <typename T>
-struct Modulator : public Combiner<T, std::multiplies<T>>
-{
-	using Combiner<T, std::multiplies<T>>::Combiner;
-};
-
-template <typename T>
-class AlsaMonoSink
-{
-public:
-	AlsaMonoSink(const DataChannel<T>& dataChannel)
-		: dataChannel(dataChannel),
-		  alsa(1, 48000, 500000)
-	{ }
-
-	void run()
-	{
-		alsa.write(dataChannel.stream->getData(dataChannel.channel));
 	}
 
-private:
-	DataChannel<T> dataChannel;
-	Alsa<T> alsa;
-};
-
-template <typename T>
-class AlsaStereoSink
-{
-public:
-	AlsaStereoSink(const DataChannel<T>& dataChannelLeft, DataChannel<T> dataChannelRight)
-		: dataChannelLeft(dataChannelLeft), dataChannelRight(dataChannelRight),
-		  alsa(2, 48000, 500000)
-	{ }
-
-	void run()
+	void render(Slot& slot)
 	{
-		auto& dataLeft = dataChannelLeft.stream->getData(dataChannelLeft.channel);
-		auto& dataRight = dataChannelRight.stream->getData(dataChannelRight.channel);
+		AllocationFreeScope scope;
+		DeadlineMonitor::Cycle timing(monitor);
 
-		if (dataLeft.size() != dataRight.size())
-		{
-			std::cerr << "Size mismatch! (" << dataLeft.size() << " vs " << dataRight.size() << ")\n";
-			return;
-		}
+		size_t period = alsa->period();
 
-		buf.clear();
-		for (size_t i = 0; i < dataLeft.size(); i++)
+		if (cycle)
 		{
-			buf.push_back(dataLeft[i]);
-			buf.push_back(dataRight[i]);
+			cycle(period);
 		}
 
-		alsa.write(buf);
-	}
-
-private:
-	std::vector<T> buf;
-	DataChannel<T> dataChannelLeft;
-	DataChannel<T> dataChannelRight;
-	Alsa<T> alsa;
-};
+		scheduler.pull(views.data(), period);
 
-template <typename T>
-class DelayLine : public DataStream<T>
-{
-public:
-	DelayLine(const DataChannel<T>& dataChannel, size_t delay)
-	: dataChannel(dataChannel), buf(delay), first(true)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		if (first)
+		for (size_t c = 0; c < views.size(); c++)
 		{
-			first = false;
-
-			return buf;
+			std::copy(views[c].begin(), views[c].end(), slot.block.channel(c));
 		}
 
-		/* Deallocate the silent buffer */
-		buf = std::vector<T>();
-
-		return dataChannel.stream->getData(dataChannel.channel);
+		timing.done(period);
 	}
 
-private:
-	DataChannel<T> dataChannel;
-	std::vector<T> buf;
-	bool first;
-};
+	std::vector<DataChannel<T>> channels;
+	BranchScheduler<T> scheduler;
+	std::unique_ptr<AlsaMmap<T>> alsa;
 
-template <typename T>
-class DataBuffer : public DataStream<T>
-{
-public:
-	DataBuffer(const DataChannel<T>& dataChannel, size_t len)
-	: dataChannel(dataChannel), buf(len), len(len)
-	{ }
-
-	const std::vector<T>& getData(int channel) override
-	{
-		// XXX: Replace this with a circular buffer
-		while (tmpBuf.size() < buf.size())
-		{
-			auto& data = dataChannel.stream->getData(dataChannel.channel);
-			tmpBuf.insert(tmpBuf.end(), data.begin(), data.end());
-		}
+	/* Render thread */
+	std::function<void(size_t)> cycle;
+	std::vector<DataView<T>> views;
+	DeadlineMonitor monitor;
 
-		buf.clear();
-		buf.insert(buf.begin(), tmpBuf.begin(), tmpBuf.begin() + len);
+	/* Output side */
+	size_t next;
 
-		tmpBuf.erase(tmpBuf.begin(), tmpBuf.begin() + len);
+	Slot slots[numSlots];
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping;
+	std::atomic<uint64_t> numLate;
 
-		return buf;
-	}
-
-	inline size_t size() const { return buf.size(); }
-
-private:
-	DataChannel<T> dataChannel;
-	std::vector<T> buf;
-	std::vector<T> tmpBuf;
-	size_t len;
+	std::thread renderThread;
 };
 
 double fRand(double fMin, double fMax)
@@ -824,16 +431,10 @@ double littleError(double x, double scale = 50.0)
 	return x + fRand(-max, max);
 }
 
-std::shared_ptr<DataStream<signalType>> shittyTone(double freq, signalType amplitude,
+void shittyTone(OscillatorBankSource<signalType>& bank, double freq, signalType amplitude,
 		double vibrFreq, signalType vibrAmplitude)
 {
-	auto tone = std::make_shared<SineSource<signalType>>(littleError(freq) / 48000.0, amplitude);
-	auto vibrato = std::make_shared<SineSource<signalType>>(vibrFreq / 48000.0, vibrAmplitude);
-	auto vibratoScaler = std::make_shared<Adder<signalType>>(DataChannel<signalType>{vibrato, 0}, 1.0);
-
-	return std::make_shared<Modulator<signalType>>(
-			std::initializer_list<DataChannel<signalType>>(
-					{{tone, 0}, {vibratoScaler, 0}}));
+	bank.add(littleError(freq) / 48000.0, amplitude, vibrFreq / 48000.0, vibrAmplitude);
 }
 
 template <typename T>
@@ -863,88 +464,250 @@ std::vector<T> readFileIntoVector(std::string filename)
 
 #include "firs.h"
 
-int main()
+/* Set by SIGUSR1, for the main loop to write the profile report */
+std::atomic<bool> reportRequested(false);
+
+void requestReport(int)
+{
+	reportRequested = true;
+}
+
+void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [-p] [-a] [-r seconds] [-d device] [-l latency] [-o output [-t seconds]] [input.raw]\n"
+			"  -p          profile the nodes. The report is written on SIGUSR1, and\n"
+			"              at the end of an offline render\n"
+			"  -r seconds  write how long cycles take, against their deadline, this\n"
+			"              often (and on SIGUSR1)\n"
+			"  -a          abort if the audio path allocates, once the graph warmed up\n"
+			"  -d device   ALSA PCM to play on, e.g. \"null\" (default: \"default\")\n"
+			"  -l latency  low (2.7 ms), interactive (11 ms), balanced (64 ms, the\n"
+			"              default) or throughput (341 ms). The graph computes a\n"
+			"              period per cycle, so this sets its block size too\n"
+			"  -o output   render offline, as fast as possible, into a .wav file, a raw\n"
+			"              file or \"null\" (benchmark), instead of playing\n"
+			"  -t seconds  how much to render offline (default: the input's length)\n";
+}
+
+int main(int argc, char** argv)
 {
 	std::string filename = "/home/tom/git/BrownNote/file.raw";
+	std::string device = "default";
+	std::string outputName;
+	double seconds = 0;
+	bool checked = false;
+	double reportInterval = 0;
+	AlsaLatency latency = AlsaLatency::Balanced;
+	const int rate = 48000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "par:d:l:o:t:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p': profiling() = true; break;
+		case 'a': checked = true; break;
+		case 'r': reportInterval = atof(optarg); break;
+		case 'd': device = optarg; break;
+		case 'o': outputName = optarg; break;
+		case 't': seconds = atof(optarg); break;
+		case 'l':
+		{
+			std::string name = optarg;
+			for (auto x: {AlsaLatency::Low, AlsaLatency::Interactive, AlsaLatency::Balanced, AlsaLatency::Throughput})
+			{
+				if (name == alsaLatencyName(x))
+				{
+					latency = x;
+				}
+			}
+			if (name != alsaLatencyName(latency))
+			{
+				std::cerr << "Unknown latency: " << name << '\n';
+				return 1;
+			}
+			break;
+		}
+		default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
 
-	auto fileReader = std::make_shared<FileReaderSoure<int16_t>>(filename, 2048);
+	if (optind < argc)
+	{
+		filename = argv[optind];
+	}
 
-	auto converter = std::make_shared<DataStreamConverter<signalType, int16_t>>(fileReader,
-			[] (int16_t x) { return (float) x / 32768.0f; });
+	/* Playing live, the device is opened first, and its period becomes the
+	 * graph's block size: one cycle of the graph fills one period */
+	std::unique_ptr<AlsaMmap<signalType>> alsa;
+	size_t block = 1024;
 
-	auto deinterleaved = std::make_shared<StreamDeinterleaver<signalType>>(
-			DataChannel<signalType> {converter, 0}, 2);
+	if (outputName.empty())
+	{
+		alsa = std::make_unique<AlsaMmap<signalType>>(2, alsaPreset(latency, rate), device);
+		block = alsa->period();
 
-	auto splitLeft = std::make_shared<Splitter<signalType>>(DataChannel<signalType>{deinterleaved, 0}, 2);
-	auto delayedLeft = std::make_shared<DelayLine<signalType>>(DataChannel<signalType>{splitLeft, 0}, 48000 / 8);
-	auto bufferedLeft = std::make_shared<DataBuffer<signalType>>(DataChannel<signalType>{delayedLeft, 0}, 1024);
-	auto attenLeft = std::make_shared<Gain<signalType>>(DataChannel<signalType>{bufferedLeft, 0}, .25);
+		const AlsaConfig& settings = alsa->settings();
+		std::cerr << "Playing on " << device << " at " << settings.rate << " Hz, "
+				<< settings.periods << " periods of " << settings.period << " frames ("
+				<< settings.latency() * 1000 << " ms)\n";
 
-	auto echoLeft = std::make_shared<Mixer<signalType>>(
-			std::initializer_list<DataChannel<signalType>>(
-					{{splitLeft, 1}, {attenLeft, 0}}));
+		if ((int) settings.rate != rate)
+		{
+			std::cerr << "The graph is made for " << rate << " Hz, it will play at the wrong speed\n";
+		}
+	}
+
+	/* Mapped rather than read: both channels come from the page cache in place */
+	auto file = std::make_shared<MappedFileSource<int16_t>>(filename, 2, block);
+
+	auto left = std::make_shared<DataStreamConverter<signalType, int16_t>>(DataChannel<int16_t>{file, 0}, fullScale<int16_t>());
+	auto right = std::make_shared<DataStreamConverter<signalType, int16_t>>(DataChannel<int16_t>{file, 1}, fullScale<int16_t>());
 
 	auto coeffs_bass = std::make_shared<std::vector<signalType>>(filter_taps_bass, filter_taps_bass + FILTER_TAP_NUM_BASS);
 	auto coeffs_treble = std::make_shared<std::vector<signalType>>(filter_taps_treble, filter_taps_treble + FILTER_TAP_NUM_TREBLE);
 	
-	auto splitRight = std::make_shared<Splitter<signalType>>(DataChannel<signalType>{deinterleaved, 1}, 3);
+	/* The bass filter was designed for 4800 Hz, so run it at a tenth of the rate */
+	auto bass = std::make_shared<MultirateFirFilter<signalType>>(DataChannel<signalType>{right, 0}, coeffs_bass, 48000 / 4800);
+	auto treble = std::make_shared<FirFilter<signalType>>(DataChannel<signalType>{right, 0}, coeffs_treble);
 
-	auto bass = std::make_shared<FirFilter<signalType>>(DataChannel<signalType>{splitRight, 0}, coeffs_bass);
-	auto treble = std::make_shared<FirFilter<signalType>>(DataChannel<signalType>{splitRight, 1}, coeffs_treble);
+	/* Everything is delayed to line up with the slowest filter, the left
+	 * channel too */
+	size_t lag = std::max(bass->latency(), treble->latency());
 
-	auto bassBuffered = std::make_shared<DataBuffer<signalType>>(DataChannel<signalType>{bass, 0}, 1024);
-	auto trebleBuffered = std::make_shared<DataBuffer<signalType>>(DataChannel<signalType>{treble, 0}, 1024);
+	/* The input, plus itself an eighth of a second before at a quarter */
+	auto echoLeft = std::make_shared<DelayLine<signalType>>(DataChannel<signalType>{left, 0},
+			std::vector<DelayTap<signalType>>{{lag, 1}, {lag + 48000 / 8, .25}});
 
-	//auto bassClipper = std::make_shared<Clip<signalType>>(DataChannel<signalType>{bassBuffered, 0}, -.1, .1);
-	auto bassClipper = std::make_shared<Clip<signalType>>(DataChannel<signalType>{bassBuffered, 0}, -1, 1);
+	auto bassDelayed = std::make_shared<DelayLine<signalType>>(DataChannel<signalType>{bass, 0}, lag - bass->latency());
+	auto trebleDelayed = std::make_shared<DelayLine<signalType>>(DataChannel<signalType>{treble, 0}, lag - treble->latency());
+	auto dryDelayed = std::make_shared<DelayLine<signalType>>(DataChannel<signalType>{right, 0}, lag);
 
-	auto bassGain = std::make_shared<Gain<signalType>>(DataChannel<signalType>{bassClipper, 0}, 1);
-	auto trebleGain = std::make_shared<Gain<signalType>>(DataChannel<signalType>{trebleBuffered, 0}, 1);
+	/* Clip and gain in one pass */
+	//auto bassGain = pointwise(DataChannel<signalType>{bassDelayed, 0}, ClipOp<signalType>{-.1, .1}, GainOp<signalType>{1});
+	auto bassGain = pointwise(DataChannel<signalType>{bassDelayed, 0}, ClipOp<signalType>{-1, 1}, GainOp<signalType>{1});
+	auto trebleGain = std::make_shared<Gain<signalType>>(DataChannel<signalType>{trebleDelayed, 0}, 1);
 
 	auto eq = std::make_shared<Mixer<signalType>>(
 			std::initializer_list<DataChannel<signalType>>({
 				{bassGain, 0},
 				{trebleGain, 0},
-				{splitRight, 2}
+				{dryDelayed, 0}
 				}));
 
 
-	AlsaStereoSink<signalType> s({echoLeft, 0}, {eq, 0});
+	/* The echo and the EQ each read a channel of their own from the file,
+	 * so they run side by side. One worker next to this thread is all
+	 * two branches need. */
+	Graph graph(std::make_shared<ThreadPool>(1));
+
+	graph.add({file, left, right, echoLeft,
+		bass, treble, bassDelayed, trebleDelayed, dryDelayed, bassGain, trebleGain, eq});
+
+	/* For the profile report */
+	for (auto& x: std::initializer_list<std::pair<std::shared_ptr<Node>, const char*>>{
+		{file, "file"}, {left, "left"}, {right, "right"}, {echoLeft, "echoLeft"},
+		{bass, "bass"}, {treble, "treble"}, {bassDelayed, "bassDelayed"}, {trebleDelayed, "trebleDelayed"},
+		{dryDelayed, "dryDelayed"},
+		{bassGain, "bassGain"}, {trebleGain, "trebleGain"}, {eq, "eq"}})
+	{
+		x.first->setName(x.second);
+	}
+
+	signal(SIGUSR1, requestReport);
+
+	std::vector<DataChannel<signalType>> outputs{{echoLeft, 0}, {eq, 0}};
+
+	auto compile = [&graph, checked] (const std::vector<Node::Input>& inputs, size_t frames)
+	{
+		for (auto& x: inputs)
+		{
+			graph.addOutput(x);
+		}
+
+		graph.compile(frames);
+
+		if (checked)
+		{
+			graph.checkAllocationsAfter(100);
+		}
+	};
+
+	if (!outputName.empty())
+	{
+		Sink<signalType> s(std::move(outputs), openOutput<signalType>(outputName, 2, rate), nullptr, block);
+		compile(s.inputs(), s.blockFrames());
+
+		auto stats = renderOffline(graph, s, seconds > 0 ? seconds : (double) file->numFrames() / rate);
+
+		std::cerr << "Rendered " << stats.audioSeconds << " s in " << stats.wallSeconds << " s: "
+				<< stats.samplesPerSecond() / 1e6 << " Msamples/s, "
+				<< stats.realtimeFactor() << "x real time\n";
+
+		if (reportInterval > 0 || reportRequested)
+		{
+			s.deadlines().report(std::cerr);
+		}
+
+		if (profiling() || reportRequested)
+		{
+			graph.report(std::cerr);
+		}
+
+		return 0;
+	}
+
+	/* The graph renders on a thread of its own, ahead of the device */
+	AsyncAlsaSink<signalType> s(std::move(outputs), std::move(alsa));
 	//AlsaMonoSink<signalType> s({right, 0});
 
-	while (true)
+	compile(s.inputs(), s.period());
+
+	s.start([&graph] (size_t frames) { graph.run(frames); });
+
+	uint64_t xruns = 0;
+	auto nextReport = std::chrono::steady_clock::now();
+	while (s.run())
 	{
-		s.run();
+		if (s.xruns() != xruns)
+		{
+			xruns = s.xruns();
+			std::cerr << "xrun (" << xruns << " so far, " << s.late() << " periods rendered late)\n";
+		}
+
+		bool requested = reportRequested.exchange(false);
+		if (requested && profiling())
+		{
+			graph.report(std::cerr);
+		}
+
+		if (requested || (reportInterval > 0 && std::chrono::steady_clock::now() >= nextReport))
+		{
+			s.deadlines().report(std::cerr);
+			nextReport = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(reportInterval));
+		}
 	}
 
-	return 0;
+	return 1;
 #if 0
 #if 1
-	auto tone1 = shittyTone(125.0 / 2, 0.2, .1, 0.2);
-	auto tone2 = shittyTone(125.0 / 4, 0.3, .3, 0.2);
-	auto tone3 = shittyTone(125, 0.5, .5, 0.2);
-	auto tone4 = shittyTone(250, 1.0, .7, 0.2);
-	auto tone5 = shittyTone(500, 0.5, .6, 0.2);
-	auto tone6 = shittyTone(1000.0, 0.4, .5, 0.2);
-	auto tone7 = shittyTone(2000.0, 0.1, .3, 0.2);
-
-	auto tone9 = shittyTone(2500 * 3, .05, 5, 0.2);
-	auto tone10 = shittyTone(250 / 3, .15, 5, 0.2);
+	auto tones = std::make_shared<OscillatorBankSource<signalType>>();
+	shittyTone(*tones, 125.0 / 2, 0.2, .1, 0.2);
+	shittyTone(*tones, 125.0 / 4, 0.3, .3, 0.2);
+	shittyTone(*tones, 125, 0.5, .5, 0.2);
+	shittyTone(*tones, 250, 1.0, .7, 0.2);
+	shittyTone(*tones, 500, 0.5, .6, 0.2);
+	shittyTone(*tones, 1000.0, 0.4, .5, 0.2);
+	shittyTone(*tones, 2000.0, 0.1, .3, 0.2);
+
+	shittyTone(*tones, 2500 * 3, .05, 5, 0.2);
+	shittyTone(*tones, 250 / 3, .15, 5, 0.2);
 
 	auto hisssss =  std::make_shared<NoiseSource<signalType>>(1.0);
 
-	auto combinedTones = std::make_shared<Mixer<signalType>>(
-			std::initializer_list<DataChannel<signalType>>(
-	auto combinedTones = std::make_shared<Mixer<signalType>>(
-			std::initializer_list<DataChannel<signalType>>(
-					{ { tone1, 0 }, { tone2, 0 },
-					  { tone3, 0 }, { tone4, 0 },
-					  { tone5, 0 }, { tone6, 0 },
-					  { tone7, 0 }, { tone9, 0 },
-					  { tone10, 0 }, }));
-
-	auto masterChannel = std::make_shared<Gain<signalType>>(DataChannel<signalType>{combinedTones, 0},
-			1.0 / combinedTones->numStreams());
+	auto masterChannel = std::make_shared<Gain<signalType>>(DataChannel<signalType>{tones, 0},
+			1.0 / tones->partials().size());
 
 	auto coeffs = std::make_shared<std::vector<signalType>>(
 			std::initializer_list<signalType>({
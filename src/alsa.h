@@ -12,34 +12,235 @@
 #include <cstdint>
 #include <vector>
 #include <type_traits>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+#include <cerrno>
+
+#include "output.h"
+
+template <typename T>
+inline snd_pcm_format_t alsaFormat()
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if (std::is_same<T, int8_t>::value)
+	{
+		return SND_PCM_FORMAT_S8;
+	}
+	if (std::is_same<T, uint8_t>::value)
+	{
+		return SND_PCM_FORMAT_U8;
+	}
+	if (std::is_same<T, int16_t>::value)
+	{
+		return SND_PCM_FORMAT_S16_BE;
+	}
+	if (std::is_same<T, uint16_t>::value)
+	{
+		return SND_PCM_FORMAT_U16_BE;
+	}
+	if (std::is_same<T, int32_t>::value)
+	{
+		return SND_PCM_FORMAT_S32_BE;
+	}
+	if (std::is_same<T, uint32_t>::value)
+	{
+		return SND_PCM_FORMAT_U32_BE;
+	}
+	if (std::is_same<T, float>::value)
+	{
+		return SND_PCM_FORMAT_FLOAT_BE;
+	}
+	if (std::is_same<T, double>::value)
+	{
+		return SND_PCM_FORMAT_FLOAT64_BE;
+	}
+#else
+	if (std::is_same<T, int8_t>::value)
+	{
+		return SND_PCM_FORMAT_S8;
+	}
+	if (std::is_same<T, uint8_t>::value)
+	{
+		return SND_PCM_FORMAT_U8;
+	}
+	if (std::is_same<T, int16_t>::value)
+	{
+		return SND_PCM_FORMAT_S16_LE;
+	}
+	if (std::is_same<T, uint16_t>::value)
+	{
+		return SND_PCM_FORMAT_U16_LE;
+	}
+	if (std::is_same<T, int32_t>::value)
+	{
+		return SND_PCM_FORMAT_S32_LE;
+	}
+	if (std::is_same<T, uint32_t>::value)
+	{
+		return SND_PCM_FORMAT_U32_LE;
+	}
+	if (std::is_same<T, float>::value)
+	{
+		return SND_PCM_FORMAT_FLOAT_LE;
+	}
+	if (std::is_same<T, double>::value)
+	{
+		return SND_PCM_FORMAT_FLOAT64_LE;
+	}
+
+	return SND_PCM_FORMAT_UNKNOWN;
+#endif
+}
+
+/* What to ask a playback device for. The device may not do exactly that:
+ * configureAlsa() negotiates and writes back what it settled on. */
+struct AlsaConfig
+{
+	unsigned int rate = 48000;
+	snd_pcm_uframes_t period = 1024;	/* Frames per period: what a write hands over */
+	unsigned int periods = 3;		/* Periods in the ring buffer */
+	snd_pcm_uframes_t startThreshold = 0;	/* Frames queued before playback starts, 0 for a full buffer */
+	snd_pcm_uframes_t availMin = 0;		/* Room to wait for before writing, 0 for a period */
+	bool resample = true;			/* Let ALSA resample when the device can't do the rate */
+
+	/* The buffer asked for. The device may make it a bit bigger. */
+	snd_pcm_uframes_t buffer() const { return period * periods; }
+
+	/* How long a frame takes from being written to being heard, at most */
+	double latency() const { return (double) buffer() / rate; }
+};
+
+/* Latency against robustness, from live monitoring to background playback */
+enum class AlsaLatency
+{
+	Low,
+	Interactive,
+	Balanced,
+	Throughput,
+};
+
+inline const char* alsaLatencyName(AlsaLatency latency)
+{
+	switch (latency)
+	{
+	case AlsaLatency::Low: return "low";
+	case AlsaLatency::Interactive: return "interactive";
+	case AlsaLatency::Balanced: return "balanced";
+	default: return "throughput";
+	}
+}
+
+/* Periods of 64 frames, 2 of them (2.7 ms at 48 kHz), up to 4 periods of 4096
+ * frames (341 ms) */
+inline AlsaConfig alsaPreset(AlsaLatency latency, unsigned int rate = 48000)
+{
+	AlsaConfig config;
+	config.rate = rate;
+
+	switch (latency)
+	{
+	case AlsaLatency::Low: config.period = 64; config.periods = 2; break;
+	case AlsaLatency::Interactive: config.period = 256; config.periods = 2; break;
+	case AlsaLatency::Balanced: config.period = 1024; config.periods = 3; break;
+	case AlsaLatency::Throughput: config.period = 4096; config.periods = 4; break;
+	}
+
+	return config;
+}
+
+/* Sets handle up for config through the hw and sw params, rather than
+ * snd_pcm_set_params(), which only takes a latency and picks the periods
+ * itself. The rate, period and buffer are negotiated to the nearest the device
+ * can do, and config is updated to what it settled on. Returns the buffer
+ * size in frames. Throws std::system_error, leaving the handle open. */
+inline snd_pcm_uframes_t configureAlsa(snd_pcm_t* handle, snd_pcm_format_t format, snd_pcm_access_t access,
+		unsigned int channels, AlsaConfig& config, const std::string& device)
+{
+	auto check = [&device] (int err, const char* what)
+	{
+		if (err < 0)
+		{
+			throw std::system_error(-err, std::generic_category(), device + ": " + what);
+		}
+	};
+
+	snd_pcm_hw_params_t* hw;
+	snd_pcm_hw_params_alloca(&hw);
+
+	check(snd_pcm_hw_params_any(handle, hw), "no configuration available");
+	check(snd_pcm_hw_params_set_rate_resample(handle, hw, config.resample), "can't set resampling");
+	check(snd_pcm_hw_params_set_access(handle, hw, access), "access type not available");
+	check(snd_pcm_hw_params_set_format(handle, hw, format), "sample format not available");
+	check(snd_pcm_hw_params_set_channels(handle, hw, channels), "channel count not available");
+	check(snd_pcm_hw_params_set_rate_near(handle, hw, &config.rate, nullptr), "rate not available");
+	check(snd_pcm_hw_params_set_period_size_near(handle, hw, &config.period, nullptr), "period size not available");
+
+	/* The buffer in whole periods of the size the device went for */
+	snd_pcm_uframes_t buffer = config.buffer();
+	check(snd_pcm_hw_params_set_buffer_size_near(handle, hw, &buffer), "buffer size not available");
+	check(snd_pcm_hw_params(handle, hw), "can't set hw params");
+
+	check(snd_pcm_hw_params_get_period_size(hw, &config.period, nullptr), "can't get the period size");
+	check(snd_pcm_hw_params_get_buffer_size(hw, &buffer), "can't get the buffer size");
+	config.periods = std::max<snd_pcm_uframes_t>(1, buffer / config.period);
+
+	config.startThreshold = config.startThreshold ? std::min(config.startThreshold, buffer) : buffer;
+	config.availMin = config.availMin ? config.availMin : config.period;
+
+	snd_pcm_sw_params_t* sw;
+	snd_pcm_sw_params_alloca(&sw);
+
+	check(snd_pcm_sw_params_current(handle, sw), "can't get sw params");
+	check(snd_pcm_sw_params_set_start_threshold(handle, sw, config.startThreshold), "can't set the start threshold");
+	check(snd_pcm_sw_params_set_avail_min(handle, sw, config.availMin), "can't set avail min");
+	check(snd_pcm_sw_params(handle, sw), "can't set sw params");
+
+	return buffer;
+}
 
 template <typename T>
-class Alsa {
+class Alsa : public Output<T> {
 public:
-	Alsa(int channels, int rate, int latency)
-		: channels(channels), rate(rate), latency(latency)
+	Alsa(int channels, AlsaConfig config = AlsaConfig(), const std::string& device = "default")
+		: channels(channels), config(config)
 	{
 		int err;
-		if ((err = snd_pcm_open(&handle, "default", SND_PCM_STREAM_PLAYBACK, 0)) < 0)
+		if ((err = snd_pcm_open(&handle, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0)
 		{
-			throw std::system_error(err, std::generic_category());
+			throw std::system_error(-err, std::generic_category(), device);
 		}
-		if ((err = snd_pcm_set_params(handle,
-				getFormat(),
-				SND_PCM_ACCESS_RW_INTERLEAVED,
-				channels,
-				rate,
-				1,
-				latency)) < 0)
+
+		try
 		{
-			throw std::system_error(err, std::generic_category());
+			configureAlsa(handle, alsaFormat<T>(), SND_PCM_ACCESS_RW_INTERLEAVED, channels, this->config, device);
+		}
+		catch (...)
+		{
+			snd_pcm_close(handle);
+			throw;
 		}
 	}
 
 	void write(std::vector<T>& data)
 	{
-		snd_pcm_sframes_t sendFrames = (snd_pcm_sframes_t) data.size() / channels;
-		snd_pcm_sframes_t frames = snd_pcm_writei(handle, data.data(), sendFrames);
+		write(data.data(), data.size());
+	}
+
+	bool write(const T* const* planes, size_t frames) override
+	{
+		buf.resize(frames * channels);
+		interleave(planes, channels, frames, buf.data());
+
+		return write(buf.data(), buf.size());
+	}
+
+	bool write(const T* data, size_t size)
+	{
+		snd_pcm_sframes_t sendFrames = (snd_pcm_sframes_t) size / channels;
+		snd_pcm_sframes_t frames = snd_pcm_writei(handle, data, sendFrames);
 		if (frames < 0)
 		{
 			frames = snd_pcm_recover(handle, frames, 0);
@@ -47,13 +248,23 @@ public:
 		if (frames < 0)
 		{
 			std::cerr << "snd_pcm_writei failed" << snd_strerror(frames) << '\n';
+			return false;
 		}
 		if (frames > 0 && frames < (snd_pcm_sframes_t) sendFrames)
 		{
 			std::cerr << "Short write (expected " << sendFrames << ", wrote " << frames << ")\n";
 		}
+
+		return true;
 	}
 
+	int numChannels() const override { return channels; }
+	int sampleRate() const override { return config.rate; }
+	size_t period() const override { return config.period; }
+
+	/* What the device settled on */
+	const AlsaConfig& settings() const { return config; }
+
 	virtual ~Alsa()
 	{
 		/* pass the remaining samples, otherwise they're dropped in close */
@@ -68,84 +279,209 @@ public:
 
 
 private:
-	snd_pcm_format_t getFormat()
+	int channels;
+	AlsaConfig config;
+
+	snd_pcm_t *handle;
+	std::vector<T> buf;
+};
+
+/* Playback through the mmap interface: frames are written straight into the
+ * ring buffer the device reads from, with no snd_pcm_writei() copy in between.
+ * xruns are recovered from and counted rather than only logged, so that the
+ * caller can report them. */
+template <typename T>
+class AlsaMmap : public Output<T> {
+public:
+	AlsaMmap(int channels, AlsaConfig config = AlsaConfig(), const std::string& device = "default")
+		: channels(channels), config(config), sources(channels), numXruns(0), numRecoveries(0)
 	{
-#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-		if (std::is_same<T, int8_t>::value)
-		{
-			return SND_PCM_FORMAT_S8;
-		}
-		if (std::is_same<T, uint8_t>::value)
-		{
-			return SND_PCM_FORMAT_U8;
-		}
-		if (std::is_same<T, int16_t>::value)
-		{
-			return SND_PCM_FORMAT_S16_BE;
-		}
-		if (std::is_same<T, uint16_t>::value)
-		{
-			return SND_PCM_FORMAT_U16_BE;
-		}
-		if (std::is_same<T, int32_t>::value)
-		{
-			return SND_PCM_FORMAT_S32_BE;
-		}
-		if (std::is_same<T, uint32_t>::value)
-		{
-			return SND_PCM_FORMAT_U32_BE;
-		}
-		if (std::is_same<T, float>::value)
-		{
-			return SND_PCM_FORMAT_FLOAT_BE;
-		}
-		if (std::is_same<T, double>::value)
-		{
-			return SND_PCM_FORMAT_FLOAT64_BE;
-		}
-#else
-		if (std::is_same<T, int8_t>::value)
+		int err;
+		if ((err = snd_pcm_open(&handle, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0)
 		{
-			return SND_PCM_FORMAT_S8;
+			throw std::system_error(-err, std::generic_category(), device);
 		}
-		if (std::is_same<T, uint8_t>::value)
+
+		try
 		{
-			return SND_PCM_FORMAT_U8;
+			bufferSize = configureAlsa(handle, alsaFormat<T>(), SND_PCM_ACCESS_MMAP_INTERLEAVED, channels, this->config, device);
 		}
-		if (std::is_same<T, int16_t>::value)
+		catch (...)
 		{
-			return SND_PCM_FORMAT_S16_LE;
+			snd_pcm_close(handle);
+			throw;
 		}
-		if (std::is_same<T, uint16_t>::value)
+	}
+
+	AlsaMmap(const AlsaMmap&) = delete;
+	AlsaMmap& operator=(const AlsaMmap&) = delete;
+
+	~AlsaMmap()
+	{
+		int err = snd_pcm_drain(handle);
+		if (err < 0)
 		{
-			return SND_PCM_FORMAT_U16_LE;
+			std::cerr << "snd_pcm_drain failed: " << snd_strerror(err) << '\n';
 		}
-		if (std::is_same<T, int32_t>::value)
+
+		snd_pcm_close(handle);
+	}
+
+	/* Writes frames frames of the given channels (one plane each), interleaving
+	 * them into the ring on the way. Waits for room where the ring is full.
+	 * Returns false on an error that can't be recovered from. */
+	bool write(const T* const* planes, size_t frames) override
+	{
+		size_t done = 0;
+		while (done < frames)
 		{
-			return SND_PCM_FORMAT_S32_LE;
+			snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+			if (avail < 0)
+			{
+				if (!recover(avail))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if ((size_t) avail < std::min(frames - done, (size_t) config.period))
+			{
+				/* Full before it has started: the start threshold wasn't
+				 * reached yet, start it by hand */
+				if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+				{
+					int err = snd_pcm_start(handle);
+					if (err < 0 && !recover(err))
+					{
+						return false;
+					}
+					continue;
+				}
+
+				int err = snd_pcm_wait(handle, 1000);
+				if (err < 0 && !recover(err))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			const snd_pcm_channel_area_t* areas;
+			snd_pcm_uframes_t offset;
+			snd_pcm_uframes_t n = frames - done;
+
+			int err = snd_pcm_mmap_begin(handle, &areas, &offset, &n);
+			if (err < 0)
+			{
+				if (!recover(err))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if (interleaved(areas))
+			{
+				for (int c = 0; c < channels; c++)
+				{
+					sources[c] = planes[c] + done;
+				}
+
+				T* dst = (T*) ((char*) areas[0].addr + areas[0].first / 8) + offset * channels;
+				interleave(sources.data(), channels, n, dst);
+			}
+			else
+			{
+				for (int c = 0; c < channels; c++)
+				{
+					const snd_pcm_channel_area_t& area = areas[c];
+					T* dst = (T*) ((char*) area.addr + (area.first + offset * area.step) / 8);
+					size_t stride = area.step / (8 * sizeof(T));
+					const T* src = planes[c] + done;
+
+					for (snd_pcm_uframes_t i = 0; i < n; i++)
+					{
+						dst[i * stride] = src[i];
+					}
+				}
+			}
+
+			snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, n);
+			if (committed < 0 || (snd_pcm_uframes_t) committed != n)
+			{
+				if (!recover(committed < 0 ? committed : -EPIPE))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			done += n;
 		}
-		if (std::is_same<T, uint32_t>::value)
+
+		return true;
+	}
+
+	/* Playing, as opposed to still filling up before the start */
+	bool running() const { return snd_pcm_state(handle) == SND_PCM_STATE_RUNNING; }
+
+	int numChannels() const override { return channels; }
+	int sampleRate() const override { return config.rate; }
+	size_t period() const override { return config.period; }
+	size_t buffer() const { return bufferSize; }
+
+	/* What the device settled on */
+	const AlsaConfig& settings() const { return config; }
+
+	uint64_t xruns() const { return numXruns; }
+	uint64_t recoveries() const { return numRecoveries; }
+
+private:
+	/* The usual layout: one frame after another, in channel order, so the
+	 * vector kernels can write the ring directly */
+	bool interleaved(const snd_pcm_channel_area_t* areas) const
+	{
+		for (int c = 0; c < channels; c++)
 		{
-			return SND_PCM_FORMAT_U32_LE;
+			if (areas[c].addr != areas[0].addr || areas[c].first != areas[0].first + c * 8 * sizeof(T) ||
+					areas[c].step != channels * 8 * sizeof(T))
+			{
+				return false;
+			}
 		}
-		if (std::is_same<T, float>::value)
+
+		return areas[0].first % 8 == 0;
+	}
+
+	bool recover(int err)
+	{
+		if (err == -EPIPE)
 		{
-			return SND_PCM_FORMAT_FLOAT_LE;
+			numXruns++;
 		}
-		if (std::is_same<T, double>::value)
+
+		int res = snd_pcm_recover(handle, err, 1);
+		if (res < 0)
 		{
-			return SND_PCM_FORMAT_FLOAT64_LE;
+			std::cerr << "snd_pcm_recover failed: " << snd_strerror(res) << '\n';
+			return false;
 		}
 
-		return SND_PCM_FORMAT_UNKNOWN;
-#endif
+		numRecoveries++;
+
+		return true;
 	}
 
 	int channels;
-	int rate;
-	int latency;
+	AlsaConfig config;
+	std::vector<const T*> sources;
 
 	snd_pcm_t *handle;
+	snd_pcm_uframes_t bufferSize;
+
+	std::atomic<uint64_t> numXruns;
+	std::atomic<uint64_t> numRecoveries;
 };
 
 #endif /* ALSA_H_ */
@@ -0,0 +1,549 @@
+/*
+ * audioblock.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef AUDIOBLOCK_H_
+#define AUDIOBLOCK_H_
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#include "simd.h"
+
+/* Interleaving and deinterleaving: planes holds one pointer per channel,
+ * interleaved samples are frame after frame, channel after channel.
+ *
+ * 2, 4, 6 and 8 channels of 32 bit samples (float, int32_t) and 2 channels of
+ * 16 bit ones run through vector shuffles; anything else, and what's left
+ * over at the end, is copied a sample at a time. */
+
+template <typename T>
+inline void interleaveScalar(const T* const* planes, int channels, size_t start, size_t frames, T* out)
+{
+	for (int c = 0; c < channels; c++)
+	{
+		const T* in = planes[c];
+		for (size_t i = start; i < frames; i++)
+		{
+			out[i * channels + c] = in[i];
+		}
+	}
+}
+
+template <typename T>
+inline void deinterleaveScalar(const T* in, int channels, size_t start, size_t frames, T* const* planes)
+{
+	for (int c = 0; c < channels; c++)
+	{
+		T* out = planes[c];
+		for (size_t i = start; i < frames; i++)
+		{
+			out[i] = in[i * channels + c];
+		}
+	}
+}
+
+/* The vector kernels return how many frames they did, the caller does the rest.
+ * Shuffling costs next to nothing against the loads and stores, so the SSE
+ * kernels serve AVX2 as well. */
+#if defined(SIMD_X86)
+__attribute__((target("sse2")))
+inline size_t interleaveSse(const float* const* p, int channels, size_t frames, float* out)
+{
+	size_t i = 0;
+	switch (channels)
+	{
+	case 2:
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128 l = _mm_loadu_ps(p[0] + i);
+			__m128 r = _mm_loadu_ps(p[1] + i);
+
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+		}
+		break;
+
+	case 4:
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(p[0] + i), b = _mm_loadu_ps(p[1] + i);
+			__m128 c = _mm_loadu_ps(p[2] + i), d = _mm_loadu_ps(p[3] + i);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+
+			float* o = out + 4 * i;
+			_mm_storeu_ps(o, a);
+			_mm_storeu_ps(o + 4, b);
+			_mm_storeu_ps(o + 8, c);
+			_mm_storeu_ps(o + 12, d);
+		}
+		break;
+
+	case 6:
+		for (; i + 4 <= frames; i += 4)
+		{
+			/* Channels 0 to 3 transposed into frames, channels 4 and 5 paired
+			 * up, then the pairs slotted in between */
+			__m128 a = _mm_loadu_ps(p[0] + i), b = _mm_loadu_ps(p[1] + i);
+			__m128 c = _mm_loadu_ps(p[2] + i), d = _mm_loadu_ps(p[3] + i);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+
+			__m128 e = _mm_loadu_ps(p[4] + i), f = _mm_loadu_ps(p[5] + i);
+			__m128 lo = _mm_unpacklo_ps(e, f);
+			__m128 hi = _mm_unpackhi_ps(e, f);
+
+			float* o = out + 6 * i;
+			_mm_storeu_ps(o, a);
+			_mm_storeu_ps(o + 4, _mm_movelh_ps(lo, b));
+			_mm_storeu_ps(o + 8, _mm_shuffle_ps(b, lo, _MM_SHUFFLE(3, 2, 3, 2)));
+			_mm_storeu_ps(o + 12, c);
+			_mm_storeu_ps(o + 16, _mm_movelh_ps(hi, d));
+			_mm_storeu_ps(o + 20, _mm_shuffle_ps(d, hi, _MM_SHUFFLE(3, 2, 3, 2)));
+		}
+		break;
+
+	case 8:
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(p[0] + i), b = _mm_loadu_ps(p[1] + i);
+			__m128 c = _mm_loadu_ps(p[2] + i), d = _mm_loadu_ps(p[3] + i);
+			__m128 e = _mm_loadu_ps(p[4] + i), f = _mm_loadu_ps(p[5] + i);
+			__m128 g = _mm_loadu_ps(p[6] + i), h = _mm_loadu_ps(p[7] + i);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			_MM_TRANSPOSE4_PS(e, f, g, h);
+
+			float* o = out + 8 * i;
+			_mm_storeu_ps(o, a);
+			_mm_storeu_ps(o + 4, e);
+			_mm_storeu_ps(o + 8, b);
+			_mm_storeu_ps(o + 12, f);
+			_mm_storeu_ps(o + 16, c);
+			_mm_storeu_ps(o + 20, g);
+			_mm_storeu_ps(o + 24, d);
+			_mm_storeu_ps(o + 28, h);
+		}
+		break;
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+inline size_t deinterleaveSse(const float* in, int channels, size_t frames, float* const* p)
+{
+	size_t i = 0;
+	switch (channels)
+	{
+	case 2:
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(in + 2 * i);
+			__m128 y = _mm_loadu_ps(in + 2 * i + 4);
+
+			_mm_storeu_ps(p[0] + i, _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(p[1] + i, _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		break;
+
+	case 4:
+		for (; i + 4 <= frames; i += 4)
+		{
+			const float* s = in + 4 * i;
+			__m128 a = _mm_loadu_ps(s), b = _mm_loadu_ps(s + 4);
+			__m128 c = _mm_loadu_ps(s + 8), d = _mm_loadu_ps(s + 12);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+
+			_mm_storeu_ps(p[0] + i, a);
+			_mm_storeu_ps(p[1] + i, b);
+			_mm_storeu_ps(p[2] + i, c);
+			_mm_storeu_ps(p[3] + i, d);
+		}
+		break;
+
+	case 6:
+		for (; i + 4 <= frames; i += 4)
+		{
+			const float* s = in + 6 * i;
+			__m128 v0 = _mm_loadu_ps(s), v1 = _mm_loadu_ps(s + 4), v2 = _mm_loadu_ps(s + 8);
+			__m128 v3 = _mm_loadu_ps(s + 12), v4 = _mm_loadu_ps(s + 16), v5 = _mm_loadu_ps(s + 20);
+
+			/* Channels 0 to 3 of each frame, transposed into channels */
+			__m128 a = v0;
+			__m128 b = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 3, 2));
+			__m128 c = v3;
+			__m128 d = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(1, 0, 3, 2));
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+
+			/* Channels 4 and 5 of each frame, then split */
+			__m128 t0 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(3, 2, 1, 0));
+			__m128 t1 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(3, 2, 1, 0));
+
+			_mm_storeu_ps(p[0] + i, a);
+			_mm_storeu_ps(p[1] + i, b);
+			_mm_storeu_ps(p[2] + i, c);
+			_mm_storeu_ps(p[3] + i, d);
+			_mm_storeu_ps(p[4] + i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(p[5] + i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		break;
+
+	case 8:
+		for (; i + 4 <= frames; i += 4)
+		{
+			const float* s = in + 8 * i;
+			__m128 a = _mm_loadu_ps(s), e = _mm_loadu_ps(s + 4);
+			__m128 b = _mm_loadu_ps(s + 8), f = _mm_loadu_ps(s + 12);
+			__m128 c = _mm_loadu_ps(s + 16), g = _mm_loadu_ps(s + 20);
+			__m128 d = _mm_loadu_ps(s + 24), h = _mm_loadu_ps(s + 28);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			_MM_TRANSPOSE4_PS(e, f, g, h);
+
+			_mm_storeu_ps(p[0] + i, a);
+			_mm_storeu_ps(p[1] + i, b);
+			_mm_storeu_ps(p[2] + i, c);
+			_mm_storeu_ps(p[3] + i, d);
+			_mm_storeu_ps(p[4] + i, e);
+			_mm_storeu_ps(p[5] + i, f);
+			_mm_storeu_ps(p[6] + i, g);
+			_mm_storeu_ps(p[7] + i, h);
+		}
+		break;
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+inline size_t interleaveSse(const int16_t* const* p, int channels, size_t frames, int16_t* out)
+{
+	size_t i = 0;
+	if (channels == 2)
+	{
+		for (; i + 8 <= frames; i += 8)
+		{
+			__m128i l = _mm_loadu_si128((const __m128i*) (p[0] + i));
+			__m128i r = _mm_loadu_si128((const __m128i*) (p[1] + i));
+
+			_mm_storeu_si128((__m128i*) (out + 2 * i), _mm_unpacklo_epi16(l, r));
+			_mm_storeu_si128((__m128i*) (out + 2 * i + 8), _mm_unpackhi_epi16(l, r));
+		}
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+inline size_t deinterleaveSse(const int16_t* in, int channels, size_t frames, int16_t* const* p)
+{
+	size_t i = 0;
+	if (channels == 2)
+	{
+		for (; i + 8 <= frames; i += 8)
+		{
+			/* Each frame as a 32 bit word: the left sample in the low half,
+			 * the right one in the high half. Sign extending either half keeps
+			 * it in range, so packing doesn't saturate. */
+			__m128i x = _mm_loadu_si128((const __m128i*) (in + 2 * i));
+			__m128i y = _mm_loadu_si128((const __m128i*) (in + 2 * i + 8));
+
+			__m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16), _mm_srai_epi32(_mm_slli_epi32(y, 16), 16));
+			__m128i r = _mm_packs_epi32(_mm_srai_epi32(x, 16), _mm_srai_epi32(y, 16));
+
+			_mm_storeu_si128((__m128i*) (p[0] + i), l);
+			_mm_storeu_si128((__m128i*) (p[1] + i), r);
+		}
+	}
+
+	return i;
+}
+#endif
+
+#if defined(SIMD_NEON)
+inline size_t interleaveNeon(const float* const* p, int channels, size_t frames, float* out)
+{
+	size_t i = 0;
+	switch (channels)
+	{
+	case 2:
+		for (; i + 4 <= frames; i += 4)
+		{
+			float32x4x2_t v = {{ vld1q_f32(p[0] + i), vld1q_f32(p[1] + i) }};
+			vst2q_f32(out + 2 * i, v);
+		}
+		break;
+
+	case 4:
+		for (; i + 4 <= frames; i += 4)
+		{
+			float32x4x4_t v = {{ vld1q_f32(p[0] + i), vld1q_f32(p[1] + i), vld1q_f32(p[2] + i), vld1q_f32(p[3] + i) }};
+			vst4q_f32(out + 4 * i, v);
+		}
+		break;
+	}
+
+	return i;
+}
+
+inline size_t deinterleaveNeon(const float* in, int channels, size_t frames, float* const* p)
+{
+	size_t i = 0;
+	switch (channels)
+	{
+	case 2:
+		for (; i + 4 <= frames; i += 4)
+		{
+			float32x4x2_t v = vld2q_f32(in + 2 * i);
+			vst1q_f32(p[0] + i, v.val[0]);
+			vst1q_f32(p[1] + i, v.val[1]);
+		}
+		break;
+
+	case 4:
+		for (; i + 4 <= frames; i += 4)
+		{
+			float32x4x4_t v = vld4q_f32(in + 4 * i);
+			for (int c = 0; c < 4; c++)
+			{
+				vst1q_f32(p[c] + i, v.val[c]);
+			}
+		}
+		break;
+	}
+
+	return i;
+}
+
+inline size_t interleaveNeon(const int16_t* const* p, int channels, size_t frames, int16_t* out)
+{
+	size_t i = 0;
+	if (channels == 2)
+	{
+		for (; i + 8 <= frames; i += 8)
+		{
+			int16x8x2_t v = {{ vld1q_s16(p[0] + i), vld1q_s16(p[1] + i) }};
+			vst2q_s16(out + 2 * i, v);
+		}
+	}
+
+	return i;
+}
+
+inline size_t deinterleaveNeon(const int16_t* in, int channels, size_t frames, int16_t* const* p)
+{
+	size_t i = 0;
+	if (channels == 2)
+	{
+		for (; i + 8 <= frames; i += 8)
+		{
+			int16x8x2_t v = vld2q_s16(in + 2 * i);
+			vst1q_s16(p[0] + i, v.val[0]);
+			vst1q_s16(p[1] + i, v.val[1]);
+		}
+	}
+
+	return i;
+}
+#endif
+
+template <typename W>
+inline size_t interleaveVector(const W* const* planes, int channels, size_t frames, W* out)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2:
+	case SimdIsa::Sse: return interleaveSse(planes, channels, frames, out);
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: return interleaveNeon(planes, channels, frames, out);
+#endif
+	default: return 0;
+	}
+}
+
+template <typename W>
+inline size_t deinterleaveVector(const W* in, int channels, size_t frames, W* const* planes)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2:
+	case SimdIsa::Sse: return deinterleaveSse(in, channels, frames, planes);
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: return deinterleaveNeon(in, channels, frames, planes);
+#endif
+	default: return 0;
+	}
+}
+
+/* Interleaves frames frames of channels planes into out. Only moves bits, so
+ * any 32 bit sample goes through the float kernels. */
+template <typename T>
+inline void interleave(const T* const* planes, int channels, size_t frames, T* out)
+{
+	size_t done = 0;
+
+	if (sizeof(T) == sizeof(float))
+	{
+		done = interleaveVector(reinterpret_cast<const float* const*>(planes), channels, frames, reinterpret_cast<float*>(out));
+	}
+	else if (sizeof(T) == sizeof(int16_t))
+	{
+		done = interleaveVector(reinterpret_cast<const int16_t* const*>(planes), channels, frames, reinterpret_cast<int16_t*>(out));
+	}
+
+	interleaveScalar(planes, channels, done, frames, out);
+}
+
+/* Splits frames interleaved frames of channels channels into planes */
+template <typename T>
+inline void deinterleave(const T* in, int channels, size_t frames, T* const* planes)
+{
+	size_t done = 0;
+
+	if (sizeof(T) == sizeof(float))
+	{
+		done = deinterleaveVector(reinterpret_cast<const float*>(in), channels, frames, reinterpret_cast<float* const*>(planes));
+	}
+	else if (sizeof(T) == sizeof(int16_t))
+	{
+		done = deinterleaveVector(reinterpret_cast<const int16_t*>(in), channels, frames, reinterpret_cast<int16_t* const*>(planes));
+	}
+
+	deinterleaveScalar(in, channels, done, frames, planes);
+}
+
+/* A block of frames, one plane per channel. The planes sit in one allocation,
+ * each starting on a cache line, so kernels can stream through them and
+ * channels don't share lines between threads. Holds up to capacity() frames,
+ * of which frames() are in use. Zeroed when it's made. */
+template <typename T>
+class AudioBlock
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	AudioBlock()
+		: samples(nullptr), stride(0), maxFrames(0), count(0)
+	{ }
+
+	AudioBlock(int channels, size_t capacity)
+		: stride(padded(capacity)), maxFrames(capacity), count(0), pointers(channels)
+	{
+		samples = static_cast<T*>(aligned_alloc(alignment, std::max<size_t>(1, channels) * stride * sizeof(T)));
+		if (!samples)
+		{
+			throw std::bad_alloc();
+		}
+
+		std::fill(samples, samples + channels * stride, T());
+
+		for (int c = 0; c < channels; c++)
+		{
+			pointers[c] = samples + c * stride;
+		}
+	}
+
+	AudioBlock(AudioBlock&& other)
+		: samples(other.samples), stride(other.stride), maxFrames(other.maxFrames),
+		  count(other.count), pointers(std::move(other.pointers))
+	{
+		other.samples = nullptr;
+		other.maxFrames = other.count = 0;
+		other.pointers.clear();
+	}
+
+	AudioBlock& operator=(AudioBlock&& other)
+	{
+		if (this != &other)
+		{
+			free(samples);
+
+			samples = other.samples;
+			stride = other.stride;
+			maxFrames = other.maxFrames;
+			count = other.count;
+			pointers = std::move(other.pointers);
+
+			other.samples = nullptr;
+			other.maxFrames = other.count = 0;
+			other.pointers.clear();
+		}
+
+		return *this;
+	}
+
+	AudioBlock(const AudioBlock&) = delete;
+	AudioBlock& operator=(const AudioBlock&) = delete;
+
+	~AudioBlock() { free(samples); }
+
+	int numChannels() const { return pointers.size(); }
+	size_t frames() const { return count; }
+	size_t capacity() const { return maxFrames; }
+
+	/* Throws std::length_error past the capacity */
+	void setFrames(size_t n)
+	{
+		if (n > maxFrames)
+		{
+			throw std::length_error("AudioBlock: more frames than it holds");
+		}
+
+		count = n;
+	}
+
+	T* channel(int c) { return pointers[c]; }
+	const T* channel(int c) const { return pointers[c]; }
+
+	T* const* planes() { return pointers.data(); }
+	const T* const* planes() const { return pointers.data(); }
+
+	/* Zeroes the frames in use */
+	void silence()
+	{
+		for (T* plane: pointers)
+		{
+			std::fill(plane, plane + count, T());
+		}
+	}
+
+	/* Takes frames interleaved frames */
+	void readInterleaved(const T* in, size_t frames)
+	{
+		setFrames(frames);
+		deinterleave(in, numChannels(), frames, planes());
+	}
+
+	/* Writes the frames in use out interleaved */
+	void writeInterleaved(T* out) const
+	{
+		interleave(planes(), numChannels(), count, out);
+	}
+
+private:
+	/* Samples per plane: capacity rounded up so that every plane starts on a
+	 * cache line, also for samples whose size doesn't divide one (Int24) */
+	static size_t padded(size_t capacity)
+	{
+		size_t unit = alignment / std::gcd(alignment, sizeof(T));
+
+		return std::max<size_t>(1, (capacity + unit - 1) / unit) * unit;
+	}
+
+	T* samples;
+	size_t stride;
+	size_t maxFrames;
+	size_t count;
+	std::vector<T*> pointers;
+};
+
+#endif /* AUDIOBLOCK_H_ */
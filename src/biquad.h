@@ -0,0 +1,506 @@
+/*
+ * biquad.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef BIQUAD_H_
+#define BIQUAD_H_
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <deque>
+#include <atomic>
+#include <thread>
+
+#include "simd.h"
+
+/* One second order section, normalized to a0 = 1:
+ *
+ *   H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2) */
+template <typename T>
+struct BiquadCoefficients
+{
+	T b0 = 1, b1 = 0, b2 = 0;
+	T a1 = 0, a2 = 0;
+};
+
+/* Designs from the RBJ Audio EQ Cookbook. frequency is in cycles per sample
+ * (0 < frequency < 0.5), gain in dB. */
+struct RbjDesign
+{
+	double cosw;
+	double alpha;
+	double A;
+
+	RbjDesign(double frequency, double q, double gain = 0)
+	{
+		double w = 2 * M_PI * frequency;
+
+		cosw = cos(w);
+		alpha = sin(w) / (2 * q);
+		A = pow(10, gain / 40);
+	}
+
+	template <typename T>
+	static BiquadCoefficients<T> normalize(double b0, double b1, double b2, double a0, double a1, double a2)
+	{
+		BiquadCoefficients<T> c;
+		c.b0 = b0 / a0;
+		c.b1 = b1 / a0;
+		c.b2 = b2 / a0;
+		c.a1 = a1 / a0;
+		c.a2 = a2 / a0;
+
+		return c;
+	}
+};
+
+template <typename T>
+BiquadCoefficients<T> biquadLowPass(double frequency, double q = M_SQRT1_2)
+{
+	RbjDesign d(frequency, q);
+
+	return RbjDesign::normalize<T>((1 - d.cosw) / 2, 1 - d.cosw, (1 - d.cosw) / 2,
+			1 + d.alpha, -2 * d.cosw, 1 - d.alpha);
+}
+
+template <typename T>
+BiquadCoefficients<T> biquadHighPass(double frequency, double q = M_SQRT1_2)
+{
+	RbjDesign d(frequency, q);
+
+	return RbjDesign::normalize<T>((1 + d.cosw) / 2, -(1 + d.cosw), (1 + d.cosw) / 2,
+			1 + d.alpha, -2 * d.cosw, 1 - d.alpha);
+}
+
+template <typename T>
+BiquadCoefficients<T> biquadPeaking(double frequency, double gain, double q = M_SQRT1_2)
+{
+	RbjDesign d(frequency, q, gain);
+
+	return RbjDesign::normalize<T>(1 + d.alpha * d.A, -2 * d.cosw, 1 - d.alpha * d.A,
+			1 + d.alpha / d.A, -2 * d.cosw, 1 - d.alpha / d.A);
+}
+
+/* Shelves: gain below (low) or above (high) frequency, unity elsewhere */
+template <typename T>
+BiquadCoefficients<T> biquadLowShelf(double frequency, double gain, double q = M_SQRT1_2)
+{
+	RbjDesign d(frequency, q, gain);
+	double A = d.A, c = d.cosw, s = 2 * sqrt(A) * d.alpha;
+
+	return RbjDesign::normalize<T>(A * ((A + 1) - (A - 1) * c + s), 2 * A * ((A - 1) - (A + 1) * c), A * ((A + 1) - (A - 1) * c - s),
+			(A + 1) + (A - 1) * c + s, -2 * ((A - 1) + (A + 1) * c), (A + 1) + (A - 1) * c - s);
+}
+
+template <typename T>
+BiquadCoefficients<T> biquadHighShelf(double frequency, double gain, double q = M_SQRT1_2)
+{
+	RbjDesign d(frequency, q, gain);
+	double A = d.A, c = d.cosw, s = 2 * sqrt(A) * d.alpha;
+
+	return RbjDesign::normalize<T>(A * ((A + 1) + (A - 1) * c + s), -2 * A * ((A - 1) + (A + 1) * c), A * ((A + 1) + (A - 1) * c - s),
+			(A + 1) - (A - 1) * c + s, 2 * ((A - 1) - (A + 1) * c), (A + 1) - (A - 1) * c - s);
+}
+
+/* A biquad in state space form, 4 samples at a time: the 4 outputs and the
+ * new state are a fixed linear function of the 4 inputs and the old state.
+ * Rows are inputs 0 to 3, then the state (s1 and s2 of the transposed direct
+ * form II), columns are outputs 0 to 3, then the new s1 and s2 and two unused
+ * ones, to make rows of 8. */
+template <typename T>
+struct BiquadBlockForm
+{
+	alignas(32) T matrix[6][8];
+	alignas(16) T state[4];
+};
+
+/* One transposed direct form II step. In W, so that the block form can be
+ * worked out in double. */
+template <typename T, typename W>
+inline W biquadTick(const BiquadCoefficients<T>& c, W x, W& s1, W& s2)
+{
+	W y = c.b0 * x + s1;
+	s1 = c.b1 * x - c.a1 * y + s2;
+	s2 = c.b2 * x - c.a2 * y;
+
+	return y;
+}
+
+/* Each row is the response to a unit input (or state) with the rest zero */
+template <typename T>
+inline void biquadPrepare(const BiquadCoefficients<T>& c, BiquadBlockForm<T>& form)
+{
+	for (int row = 0; row < 6; row++)
+	{
+		double s1 = row == 4, s2 = row == 5;
+		for (int i = 0; i < 4; i++)
+		{
+			form.matrix[row][i] = biquadTick(c, (double) (row == i), s1, s2);
+		}
+
+		form.matrix[row][4] = s1;
+		form.matrix[row][5] = s2;
+		form.matrix[row][6] = form.matrix[row][7] = 0;
+	}
+}
+
+/* The block kernels run count sections over the whole 4 sample blocks of in,
+ * one block through all sections before the next: then only a section's own
+ * state links its blocks, and the sections overlap. They return the number of
+ * samples done. */
+template <typename T>
+inline size_t biquadBlocksScalar(BiquadBlockForm<T>* forms, size_t count, const T* in, T* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		T x[4] = {in[i], in[i + 1], in[i + 2], in[i + 3]};
+
+		for (size_t k = 0; k < count; k++)
+		{
+			auto& m = forms[k].matrix;
+			T* s = forms[k].state;
+			T r[6];
+
+			for (int l = 0; l < 6; l++)
+			{
+				r[l] = x[0] * m[0][l] + x[1] * m[1][l] + x[2] * m[2][l] + x[3] * m[3][l]
+						+ s[0] * m[4][l] + s[1] * m[5][l];
+			}
+
+			std::copy(r, r + 4, x);
+			s[0] = r[4];
+			s[1] = r[5];
+		}
+
+		std::copy(x, x + 4, out + i);
+	}
+
+	return i;
+}
+
+#if defined(SIMD_X86)
+__attribute__((target("sse2")))
+inline size_t biquadBlocksSse(BiquadBlockForm<float>* forms, size_t count, const float* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(in + i);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			const float* m = &forms[k].matrix[0][0];
+			float* state = forms[k].state;
+
+			__m128 x0 = _mm_shuffle_ps(x, x, 0x00), x1 = _mm_shuffle_ps(x, x, 0x55);
+			__m128 x2 = _mm_shuffle_ps(x, x, 0xaa), x3 = _mm_shuffle_ps(x, x, 0xff);
+
+			__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, _mm_load_ps(m)), _mm_mul_ps(x1, _mm_load_ps(m + 8))),
+					_mm_add_ps(_mm_mul_ps(x2, _mm_load_ps(m + 16)), _mm_mul_ps(x3, _mm_load_ps(m + 24))));
+			__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, _mm_load_ps(m + 4)), _mm_mul_ps(x1, _mm_load_ps(m + 12))),
+					_mm_add_ps(_mm_mul_ps(x2, _mm_load_ps(m + 20)), _mm_mul_ps(x3, _mm_load_ps(m + 28))));
+
+			/* Only this depends on the previous block */
+			__m128 s = _mm_load_ps(state);
+			__m128 s1 = _mm_shuffle_ps(s, s, 0x00), s2 = _mm_shuffle_ps(s, s, 0x55);
+
+			y = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(s1, _mm_load_ps(m + 32)), _mm_mul_ps(s2, _mm_load_ps(m + 40))));
+			t = _mm_add_ps(t, _mm_add_ps(_mm_mul_ps(s1, _mm_load_ps(m + 36)), _mm_mul_ps(s2, _mm_load_ps(m + 44))));
+
+			_mm_store_ps(state, t);
+			x = y;
+		}
+
+		_mm_storeu_ps(out + i, x);
+	}
+
+	return i;
+}
+
+/* Both halves of a row in one register */
+__attribute__((target("avx2,fma")))
+inline size_t biquadBlocksAvx2(BiquadBlockForm<float>* forms, size_t count, const float* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(in + i);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			const float* m = &forms[k].matrix[0][0];
+			float* state = forms[k].state;
+
+			__m256 r = _mm256_mul_ps(_mm256_set1_ps(_mm_cvtss_f32(x)), _mm256_load_ps(m));
+			r = _mm256_fmadd_ps(_mm256_broadcastss_ps(_mm_shuffle_ps(x, x, 0x55)), _mm256_load_ps(m + 8), r);
+			__m256 q = _mm256_mul_ps(_mm256_broadcastss_ps(_mm_shuffle_ps(x, x, 0xaa)), _mm256_load_ps(m + 16));
+			q = _mm256_fmadd_ps(_mm256_broadcastss_ps(_mm_shuffle_ps(x, x, 0xff)), _mm256_load_ps(m + 24), q);
+
+			/* Only this depends on the previous block */
+			r = _mm256_fmadd_ps(_mm256_broadcast_ss(state), _mm256_load_ps(m + 32), r);
+			q = _mm256_fmadd_ps(_mm256_broadcast_ss(state + 1), _mm256_load_ps(m + 40), q);
+			r = _mm256_add_ps(r, q);
+
+			_mm_store_ps(state, _mm256_extractf128_ps(r, 1));
+			x = _mm256_castps256_ps128(r);
+		}
+
+		_mm_storeu_ps(out + i, x);
+	}
+
+	return i;
+}
+#endif
+
+template <typename T>
+inline size_t biquadBlocks(BiquadBlockForm<T>* forms, size_t count, const T* in, T* out, size_t n)
+{
+	return biquadBlocksScalar(forms, count, in, out, n);
+}
+
+template <>
+inline size_t biquadBlocks(BiquadBlockForm<float>* forms, size_t count, const float* in, float* out, size_t n)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: return biquadBlocksAvx2(forms, count, in, out, n);
+	case SimdIsa::Sse: return biquadBlocksSse(forms, count, in, out, n);
+#endif
+	default: return biquadBlocksScalar(forms, count, in, out, n);
+	}
+}
+
+/* A chain of biquads in transposed direct form II.
+ *
+ * Sample by sample, a biquad is one long dependency chain: every output needs
+ * the previous one. So sections run 4 samples at a time through their block
+ * form instead (see BiquadBlockForm), worked out once per coefficient change.
+ * The inputs' share of a block is independent of the state, so only two
+ * multiply-adds per 4 samples stay on the chain, and the rest vectorizes.
+ *
+ * Coefficient changes glide: the coefficients move linearly to the new ones
+ * over rampFrames samples, computed sample by sample meanwhile. Stable
+ * sections stay stable on the way, as the set of stable (a1, a2) is convex.
+ *
+ * set() may be called from a control thread while another one runs process():
+ * the new coefficients wait in a slot of their own, and process() starts the
+ * glide at the start of its next block. Sections are only added before that. */
+template <typename T>
+class BiquadCascade
+{
+public:
+	static constexpr size_t defaultRampFrames = 256;
+
+	BiquadCascade(std::vector<BiquadCoefficients<T>> coefficients = {}, size_t rampFrames = defaultRampFrames)
+		: rampFrames(rampFrames)
+	{
+		for (auto& c: coefficients)
+		{
+			add(c);
+		}
+	}
+
+	/* Appends a section, starting at the given coefficients. Returns its index.
+	 * Only while nothing runs process(): it reallocates what that reads. */
+	size_t add(const BiquadCoefficients<T>& c)
+	{
+		sections.push_back({c, c, BiquadCoefficients<T>(), 0});
+		forms.emplace_back();
+		pending.emplace_back();
+		requested.push_back(c);
+
+		std::fill(forms.back().state, forms.back().state + 4, T());
+		biquadPrepare(c, forms.back());
+
+		return sections.size() - 1;
+	}
+
+	/* Glides section i to c over rampFrames samples, from wherever it is by
+	 * the next block. A change that's still waiting is replaced. */
+	void set(size_t i, const BiquadCoefficients<T>& c)
+	{
+		requested[i] = c;
+
+		/* Only waits while process() copies the previous one out */
+		Pending& p = pending[i];
+		int state = p.state.load(std::memory_order_relaxed);
+		do
+		{
+			while (state == writing || state == reading)
+			{
+				std::this_thread::yield();
+				state = p.state.load(std::memory_order_relaxed);
+			}
+		} while (!p.state.compare_exchange_weak(state, writing, std::memory_order_acquire));
+
+		p.coefficients = c;
+		p.state.store(ready, std::memory_order_release);
+	}
+
+	/* What section i was last set to */
+	const BiquadCoefficients<T>& get(size_t i) const { return requested[i]; }
+	size_t size() const { return sections.size(); }
+
+	/* For the glides that start from now on */
+	void setRampFrames(size_t n) { rampFrames.store(n, std::memory_order_relaxed); }
+
+	/* Forgets the signal so far. Not while process() runs. */
+	void reset()
+	{
+		for (auto& form: forms)
+		{
+			std::fill(form.state, form.state + 4, T());
+		}
+	}
+
+	/* in and out may be the same */
+	void process(const T* in, T* out, size_t n)
+	{
+		for (size_t k = 0; k < pending.size(); k++)
+		{
+			take(k);
+		}
+
+		size_t ramp = 0;
+		for (auto& s: sections)
+		{
+			ramp = std::max(ramp, s.ramp);
+		}
+
+		/* Sample by sample while anything glides */
+		size_t done = std::min(n, ramp);
+		if (done > 0 || sections.empty())
+		{
+			std::copy(in, in + n, out);
+			for (size_t k = 0; k < sections.size(); k++)
+			{
+				tick(k, out, done);
+			}
+			in = out;
+		}
+
+		done += biquadBlocks(forms.data(), forms.size(), in + done, out + done, n - done);
+
+		if (done < n)
+		{
+			std::copy(in + done, in + n, out + done);
+			for (size_t k = 0; k < sections.size(); k++)
+			{
+				tick(k, out + done, n - done);
+			}
+		}
+
+		/* A decaying state ends up denormal, which is slow on most CPUs */
+		for (auto& form: forms)
+		{
+			if (std::abs(form.state[0]) < (T) 1e-30 && std::abs(form.state[1]) < (T) 1e-30)
+			{
+				form.state[0] = form.state[1] = 0;
+			}
+		}
+	}
+
+private:
+	struct Section
+	{
+		BiquadCoefficients<T> target;
+		BiquadCoefficients<T> current;
+		BiquadCoefficients<T> step;	/* Per sample, while gliding */
+		size_t ramp;			/* Samples left to glide */
+	};
+
+	enum { empty, writing, ready, reading };
+
+	/* Coefficients set() left for process() */
+	struct Pending
+	{
+		BiquadCoefficients<T> coefficients;
+		std::atomic<int> state{empty};
+	};
+
+	/* Starts the glide to section k's pending coefficients, if there are any */
+	void take(size_t k)
+	{
+		Pending& p = pending[k];
+
+		int state = ready;
+		if (p.state.load(std::memory_order_relaxed) != ready
+				|| !p.state.compare_exchange_strong(state, reading, std::memory_order_acquire))
+		{
+			return;
+		}
+
+		BiquadCoefficients<T> c = p.coefficients;
+		p.state.store(empty, std::memory_order_release);
+
+		glide(k, c);
+	}
+
+	void glide(size_t k, const BiquadCoefficients<T>& c)
+	{
+		Section& s = sections[k];
+		s.target = c;
+
+		size_t frames = rampFrames.load(std::memory_order_relaxed);
+		if (frames == 0)
+		{
+			s.current = c;
+			s.ramp = 0;
+			biquadPrepare(c, forms[k]);
+			return;
+		}
+
+		T n = frames;
+		s.step.b0 = (c.b0 - s.current.b0) / n;
+		s.step.b1 = (c.b1 - s.current.b1) / n;
+		s.step.b2 = (c.b2 - s.current.b2) / n;
+		s.step.a1 = (c.a1 - s.current.a1) / n;
+		s.step.a2 = (c.a2 - s.current.a2) / n;
+		s.ramp = frames;
+	}
+
+	/* Section k over n samples in place, sample by sample */
+	void tick(size_t k, T* x, size_t n)
+	{
+		Section& s = sections[k];
+		T s1 = forms[k].state[0], s2 = forms[k].state[1];
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (s.ramp > 0)
+			{
+				s.current.b0 += s.step.b0;
+				s.current.b1 += s.step.b1;
+				s.current.b2 += s.step.b2;
+				s.current.a1 += s.step.a1;
+				s.current.a2 += s.step.a2;
+
+				if (--s.ramp == 0)
+				{
+					s.current = s.target;
+					biquadPrepare(s.current, forms[k]);
+				}
+			}
+
+			x[i] = biquadTick(s.current, x[i], s1, s2);
+		}
+
+		forms[k].state[0] = s1;
+		forms[k].state[1] = s2;
+	}
+
+	std::vector<Section> sections;
+	std::vector<BiquadBlockForm<T>> forms;
+	std::deque<Pending> pending;			/* Written by set(), read by process() */
+	std::vector<BiquadCoefficients<T>> requested;	/* What set() was last called with */
+	std::atomic<size_t> rampFrames;
+};
+
+#endif /* BIQUAD_H_ */
@@ -0,0 +1,331 @@
+/*
+ * blockpool.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef BLOCKPOOL_H_
+#define BLOCKPOOL_H_
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+
+#include "profile.h"
+
+/* Fixed size, cache line aligned sample blocks, allocated up front.
+ *
+ * Blocks are handed out from a free list and given back to it, so once the
+ * pool holds as many blocks as the graph ever has in flight, nothing gets
+ * allocated anymore. Running dry still works: the pool then allocates another
+ * block, which it counts as a miss (and as a heap allocation, see profile.h, so
+ * checkAllocations() catches it). Any thread may take and give back blocks. */
+template <typename T>
+class BlockPool
+{
+public:
+	static constexpr size_t alignment = 64;
+	static constexpr size_t defaultBlockSize = 8192;
+
+	BlockPool(size_t blockSize = defaultBlockSize, size_t count = 0)
+		: size(blockSize), numBlocks(0), numMisses(0)
+	{
+		reserve(count);
+	}
+
+	~BlockPool()
+	{
+		for (const Chunk& chunk: chunks)
+		{
+			free(chunk.begin);
+		}
+
+		for (const Chunk& chunk: retired)
+		{
+			free(chunk.begin);
+		}
+	}
+
+	BlockPool(const BlockPool&) = delete;
+	BlockPool& operator=(const BlockPool&) = delete;
+
+	/* The one the nodes draw from. Graph::compile() sizes it, and makes its
+	 * blocks big enough for the graph's. */
+	static BlockPool& shared()
+	{
+		static BlockPool pool;
+
+		return pool;
+	}
+
+	/* Adds count blocks. This allocates: do it before the audio starts. */
+	void reserve(size_t count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		Lock lock(busy);
+		allocate(count);
+	}
+
+	/* Makes the blocks hold at least blockSize samples. The pool starts over
+	 * with as many blocks of the new size, and only hands out those from now
+	 * on. The old ones that are still in use (by another graph, say) stay
+	 * valid: their chunk is freed once the last of them comes back. This
+	 * allocates, like reserve(). */
+	void fit(size_t blockSize)
+	{
+		Lock lock(busy);
+
+		if (blockSize <= size)
+		{
+			return;
+		}
+
+		for (Chunk& chunk: chunks)
+		{
+			chunk.inUse = (chunk.end - chunk.begin) / stride();
+		}
+
+		for (T* block: freeList)
+		{
+			find(chunks, block)->inUse--;
+		}
+
+		for (const Chunk& chunk: chunks)
+		{
+			if (chunk.inUse == 0)
+			{
+				free(chunk.begin);
+			}
+			else
+			{
+				retired.push_back(chunk);
+			}
+		}
+
+		size_t count = numBlocks;
+
+		chunks.clear();
+		freeList.clear();
+		numBlocks = 0;
+		size = blockSize;
+
+		if (count > 0)
+		{
+			allocate(count);
+		}
+	}
+
+	/* A free block, and its size: blockSize(), unless fit() changes that
+	 * while the block is out */
+	T* get(size_t& blockSize)
+	{
+		Lock lock(busy);
+
+		if (freeList.empty())
+		{
+			numMisses++;
+			countAllocation();
+			allocate(1);
+		}
+
+		T* block = freeList.back();
+		freeList.pop_back();
+		blockSize = size;
+
+		return block;
+	}
+
+	/* Blocks from before a fit() don't go back on the free list: the last
+	 * one of a chunk frees it. */
+	void giveBack(T* block)
+	{
+		Lock lock(busy);
+
+		if (!retired.empty())
+		{
+			auto chunk = find(retired, block);
+			if (chunk != retired.end())
+			{
+				if (--chunk->inUse == 0)
+				{
+					free(chunk->begin);
+					retired.erase(chunk);
+				}
+
+				return;
+			}
+		}
+
+		freeList.push_back(block);
+	}
+
+	size_t blockSize() const { return size; }
+	size_t capacity() const { return numBlocks; }
+	size_t misses() const { return numMisses; }
+
+private:
+	/* A spin lock: it's held for a push or a pop, and a mutex might sleep */
+	class Lock
+	{
+	public:
+		Lock(std::atomic_flag& flag)
+			: flag(flag)
+		{
+			while (flag.test_and_set(std::memory_order_acquire))
+			{ }
+		}
+
+		~Lock() { flag.clear(std::memory_order_release); }
+
+	private:
+		std::atomic_flag& flag;
+	};
+
+	/* A run of blocks allocated together. inUse only counts once the chunk is
+	 * retired by fit(). */
+	struct Chunk
+	{
+		char* begin;
+		char* end;
+		size_t inUse;
+	};
+
+	size_t stride() const { return (size * sizeof(T) + alignment - 1) / alignment * alignment; }
+
+	static typename std::vector<Chunk>::iterator find(std::vector<Chunk>& chunks, T* block)
+	{
+		char* p = reinterpret_cast<char*>(block);
+
+		return std::find_if(chunks.begin(), chunks.end(),
+				[p] (const Chunk& chunk) { return p >= chunk.begin && p < chunk.end; });
+	}
+
+	void allocate(size_t count)
+	{
+		size_t stride = this->stride();
+
+		char* chunk = static_cast<char*>(aligned_alloc(alignment, stride * count));
+		if (!chunk)
+		{
+			throw std::bad_alloc();
+		}
+
+		chunks.push_back({chunk, chunk + stride * count, 0});
+
+		/* Room for every block there is, so giving one back never allocates */
+		numBlocks += count;
+		freeList.reserve(numBlocks);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			freeList.push_back(reinterpret_cast<T*>(chunk + i * stride));
+		}
+	}
+
+	size_t size;
+	size_t numBlocks;
+	size_t numMisses;
+	std::vector<T*> freeList;
+	std::vector<Chunk> chunks;
+	std::vector<Chunk> retired;	/* From before the last fit(), with blocks still out */
+	std::atomic_flag busy = ATOMIC_FLAG_INIT;
+};
+
+/* A block from a pool, holding up to its blockSize() samples. Goes back to
+ * the pool when it's destroyed. */
+template <typename T>
+class Block
+{
+public:
+	Block()
+		: pool(nullptr), ptr(nullptr), count(0), blockSize(0)
+	{ }
+
+	explicit Block(BlockPool<T>& pool)
+		: pool(&pool), ptr(nullptr), count(0), blockSize(0)
+	{
+		ptr = pool.get(blockSize);
+	}
+
+	Block(Block&& other)
+		: pool(other.pool), ptr(other.ptr), count(other.count), blockSize(other.blockSize)
+	{
+		other.ptr = nullptr;
+		other.count = 0;
+	}
+
+	Block& operator=(Block&& other)
+	{
+		if (this != &other)
+		{
+			release();
+
+			pool = other.pool;
+			ptr = other.ptr;
+			count = other.count;
+			blockSize = other.blockSize;
+
+			other.ptr = nullptr;
+			other.count = 0;
+		}
+
+		return *this;
+	}
+
+	~Block() { release(); }
+
+	/* Throws std::length_error past the pool's block size */
+	void resize(size_t n)
+	{
+		if (n > capacity())
+		{
+			throw std::length_error("Block larger than the pool's blocks");
+		}
+
+		count = n;
+	}
+
+	void assign(const T* first, const T* last)
+	{
+		resize(last - first);
+		std::copy(first, last, ptr);
+	}
+
+	T* data() { return ptr; }
+	const T* data() const { return ptr; }
+	size_t size() const { return count; }
+	size_t capacity() const { return ptr ? blockSize : 0; }
+
+	T* begin() { return ptr; }
+	T* end() { return ptr + count; }
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + count; }
+
+	T& operator[](size_t i) { return ptr[i]; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+	void release()
+	{
+		if (ptr)
+		{
+			pool->giveBack(ptr);
+			ptr = nullptr;
+		}
+	}
+
+	BlockPool<T>* pool;
+	T* ptr;
+	size_t count;
+	size_t blockSize;	/* The pool's block size when this one was taken */
+};
+
+#endif /* BLOCKPOOL_H_ */
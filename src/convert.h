@@ -0,0 +1,461 @@
+/*
+ * convert.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef CONVERT_H_
+#define CONVERT_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+
+#include "simd.h"
+
+/* Packed little-endian 24 bit sample, as in S24_3LE */
+struct Int24
+{
+	uint8_t bytes[3];
+};
+
+/* Full scale of the integer formats */
+template <typename T> struct SampleRange;
+template <> struct SampleRange<int16_t> { static constexpr double min = -32768.0, max = 32767.0; };
+template <> struct SampleRange<Int24> { static constexpr double min = -8388608.0, max = 8388607.0; };
+template <> struct SampleRange<int32_t> { static constexpr double min = -2147483648.0, max = 2147483647.0; };
+
+/* Scale factor that maps the full range of T onto [-1, 1) */
+template <typename T>
+constexpr double fullScale() { return -1.0 / SampleRange<T>::min; }
+
+inline int32_t sampleValue(Int24 x)
+{
+	return (int32_t) ((uint32_t) x.bytes[0] << 8 | (uint32_t) x.bytes[1] << 16 | (uint32_t) x.bytes[2] << 24) >> 8;
+}
+
+template <typename T>
+inline T sampleValue(T x) { return x; }
+
+/* Largest W that is still within the range of integer format T */
+template <typename T, typename W>
+inline W sampleMax()
+{
+	W max = (W) SampleRange<T>::max;
+	return (double) max > SampleRange<T>::max ? std::nextafter(max, (W) 0) : max;
+}
+
+/* Rounds to nearest (even) and saturates to the range of T, like the
+ * vector conversions do. NaN becomes 0. */
+template <typename T, typename W>
+inline long saturate(W x)
+{
+	W min = (W) SampleRange<T>::min;
+	W max = sampleMax<T, W>();
+
+	x = x != x ? 0 : x;
+	x = x < min ? min : x;
+	x = x > max ? max : x;
+
+	return std::lrint(x);
+}
+
+inline void storeSample(float& out, float x) { out = x; }
+inline void storeSample(float& out, double x) { out = (float) x; }
+inline void storeSample(double& out, double x) { out = x; }
+inline void storeSample(double& out, float x) { out = x; }
+
+template <typename W>
+inline void storeSample(int16_t& out, W x) { out = (int16_t) saturate<int16_t>(x); }
+
+template <typename W>
+inline void storeSample(int32_t& out, W x) { out = (int32_t) saturate<int32_t>(x); }
+
+template <typename W>
+inline void storeSample(Int24& out, W x)
+{
+	uint32_t v = (uint32_t) saturate<Int24>(x);
+
+	out.bytes[0] = v;
+	out.bytes[1] = v >> 8;
+	out.bytes[2] = v >> 16;
+}
+
+/* out[i] = in[i] * scale, computed in double if either side is double and in
+ * float otherwise. Integer results are rounded to nearest and saturated. */
+template <typename From, typename To>
+inline void convertScalar(const From* in, To* out, size_t n, double scale)
+{
+	typedef typename std::conditional<std::is_same<From, double>::value || std::is_same<To, double>::value,
+			double, float>::type Work;
+
+	Work s = (Work) scale;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		storeSample(out[i], (Work) sampleValue(in[i]) * s);
+	}
+}
+
+#if defined(SIMD_X86)
+__attribute__((target("sse2")))
+inline void convertSse(const int16_t* in, float* out, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*) (in + i));
+
+		/* Sign extend by putting each sample in the top half and shifting back down */
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("sse2")))
+inline void convertSse(const float* in, int16_t* out, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	__m128 min = _mm_set1_ps((float) SampleRange<int16_t>::min);
+	__m128 max = _mm_set1_ps((float) SampleRange<int16_t>::max);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		/* Clamped, so nothing overflows cvtps, which rounds to nearest. NaNs
+		 * are masked to 0 first: max_ps would turn them into min. */
+		__m128 x0 = _mm_mul_ps(_mm_loadu_ps(in + i), s);
+		__m128 x1 = _mm_mul_ps(_mm_loadu_ps(in + i + 4), s);
+		x0 = _mm_and_ps(x0, _mm_cmpord_ps(x0, x0));
+		x1 = _mm_and_ps(x1, _mm_cmpord_ps(x1, x1));
+
+		__m128i lo = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x0, min), max));
+		__m128i hi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x1, min), max));
+
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("sse2")))
+inline void convertSse(const int32_t* in, float* out, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*) (in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(x), s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("sse2")))
+inline void convertSse(const float* in, int32_t* out, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+
+	/* cvtps gives INT_MIN for anything out of range or NaN, so mask NaNs to 0
+	 * and clamp first */
+	__m128 min = _mm_set1_ps((float) SampleRange<int32_t>::min);
+	__m128 max = _mm_set1_ps(sampleMax<int32_t, float>());
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), s);
+		x = _mm_and_ps(x, _mm_cmpord_ps(x, x));
+		x = _mm_min_ps(_mm_max_ps(x, min), max);
+
+		_mm_storeu_si128((__m128i*) (out + i), _mm_cvtps_epi32(x));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const int16_t* in, float* out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (in + i)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (in + i + 8)));
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+	}
+
+	convertSse(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const float* in, int16_t* out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	__m256 min = _mm256_set1_ps((float) SampleRange<int16_t>::min);
+	__m256 max = _mm256_set1_ps((float) SampleRange<int16_t>::max);
+
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m256 x0 = _mm256_mul_ps(_mm256_loadu_ps(in + i), s);
+		__m256 x1 = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), s);
+		x0 = _mm256_and_ps(x0, _mm256_cmp_ps(x0, x0, _CMP_ORD_Q));
+		x1 = _mm256_and_ps(x1, _mm256_cmp_ps(x1, x1, _CMP_ORD_Q));
+
+		__m256i lo = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x0, min), max));
+		__m256i hi = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x1, min), max));
+
+		/* packs works within 128 bit lanes, put the quarters back in order */
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+
+		_mm256_storeu_si256((__m256i*) (out + i), packed);
+	}
+
+	convertSse(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const int32_t* in, float* out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*) (in + i));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), s));
+	}
+
+	convertSse(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const float* in, int32_t* out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	__m256 min = _mm256_set1_ps((float) SampleRange<int32_t>::min);
+	__m256 max = _mm256_set1_ps(sampleMax<int32_t, float>());
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(in + i), s);
+		x = _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+		x = _mm256_min_ps(_mm256_max_ps(x, min), max);
+
+		_mm256_storeu_si256((__m256i*) (out + i), _mm256_cvtps_epi32(x));
+	}
+
+	convertSse(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const Int24* in, float* out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+
+	/* The three bytes of every sample go into the top of a 32 bit lane,
+	 * the arithmetic shift then sign extends them */
+	__m256i spread = _mm256_setr_epi8(
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+	const uint8_t* bytes = (const uint8_t*) in;
+
+	/* Each half loads 16 bytes for 12, so stop while that stays within the input */
+	size_t i = 0;
+	for (; i + 10 <= n; i += 8)
+	{
+		__m128i lo = _mm_loadu_si128((const __m128i*) (bytes + i * 3));
+		__m128i hi = _mm_loadu_si128((const __m128i*) (bytes + i * 3 + 12));
+
+		__m256i x = _mm256_shuffle_epi8(_mm256_set_m128i(hi, lo), spread);
+		x = _mm256_srai_epi32(x, 8);
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const float* in, double* out, size_t n, double scale)
+{
+	__m256d s = _mm256_set1_pd(scale);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256d x = _mm256_cvtps_pd(_mm_loadu_ps(in + i));
+		_mm256_storeu_pd(out + i, _mm256_mul_pd(x, s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+inline void convertAvx2(const double* in, float* out, size_t n, double scale)
+{
+	__m256d s = _mm256_set1_pd(scale);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256d x = _mm256_mul_pd(_mm256_loadu_pd(in + i), s);
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(x));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+#endif
+
+#if defined(SIMD_NEON)
+inline void convertNeon(const int16_t* in, float* out, size_t n, float scale)
+{
+	float32x4_t s = vdupq_n_f32(scale);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		int16x8_t x = vld1q_s16(in + i);
+
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), s));
+		vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+
+inline void convertNeon(const int32_t* in, float* out, size_t n, float scale)
+{
+	float32x4_t s = vdupq_n_f32(scale);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(in + i)), s));
+	}
+
+	convertScalar(in + i, out + i, n - i, scale);
+}
+#endif
+
+/* Converts n samples with out[i] = in[i] * scale, between any two of int16_t,
+ * Int24, int32_t, float and double. Integer results are rounded to nearest and
+ * saturated, NaN becomes 0. Every ISA gives the same results as the scalar
+ * code. */
+template <typename From, typename To>
+inline void convertSamples(const From* in, To* out, size_t n, double scale)
+{
+	convertScalar(in, out, n, scale);
+}
+
+template <>
+inline void convertSamples(const int16_t* in, float* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+	case SimdIsa::Sse: convertSse(in, out, n, scale); break;
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: convertNeon(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const float* in, int16_t* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+	case SimdIsa::Sse: convertSse(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const int32_t* in, float* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+	case SimdIsa::Sse: convertSse(in, out, n, scale); break;
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: convertNeon(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const float* in, int32_t* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+	case SimdIsa::Sse: convertSse(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const Int24* in, float* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const float* in, double* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+template <>
+inline void convertSamples(const double* in, float* out, size_t n, double scale)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: convertAvx2(in, out, n, scale); break;
+#endif
+	default: convertScalar(in, out, n, scale); break;
+	}
+}
+
+#endif /* CONVERT_H_ */
@@ -0,0 +1,201 @@
+/*
+ * deadline.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef DEADLINE_H_
+#define DEADLINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+/* Histogram of durations in nanoseconds, HDR style: exact below 64 ns, and
+ * 32 buckets per power of two above that, so every value is kept to within
+ * 1 / 32 (3%) of what it was, from nanoseconds to hours, in 15 kB.
+ *
+ * Recording is a relaxed atomic increment, so one thread can record while
+ * others read percentiles. */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram()
+	{
+		reset();
+	}
+
+	void record(uint64_t ns)
+	{
+		buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(1, std::memory_order_relaxed);
+
+		uint64_t max = largest.load(std::memory_order_relaxed);
+		while (ns > max && !largest.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+		{ }
+	}
+
+	/* The value p (0 to 1) of the recorded ones are at or below, rounded up
+	 * to the end of its bucket. 0 if nothing was recorded. */
+	uint64_t percentile(double p) const
+	{
+		uint64_t n = count();
+		if (n == 0)
+		{
+			return 0;
+		}
+
+		uint64_t rank = std::max<uint64_t>(1, std::ceil(p * n));
+		uint64_t seen = 0;
+
+		for (size_t i = 0; i < numBuckets; i++)
+		{
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+			{
+				return std::min(upperBound(i), max());
+			}
+		}
+
+		return max();
+	}
+
+	uint64_t count() const { return total.load(std::memory_order_relaxed); }
+	uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+
+	void reset()
+	{
+		for (auto& bucket: buckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+
+		total.store(0, std::memory_order_relaxed);
+		largest.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr int subBits = 5;
+	static constexpr uint64_t linear = 2 << subBits;
+	static constexpr size_t numBuckets = linear + (64 - subBits - 1) * (1 << subBits);
+
+	static size_t bucketOf(uint64_t ns)
+	{
+		if (ns < linear)
+		{
+			return ns;
+		}
+
+		/* The top subBits + 1 bits, of which the first is always set */
+		int shift = 63 - __builtin_clzll(ns) - subBits;
+		uint64_t top = ns >> shift;
+
+		return linear + (shift - 1) * (1 << subBits) + (top - (1 << subBits));
+	}
+
+	static uint64_t upperBound(size_t bucket)
+	{
+		if (bucket < linear)
+		{
+			return bucket;
+		}
+
+		int shift = (bucket - linear) / (1 << subBits) + 1;
+		uint64_t top = (bucket - linear) % (1 << subBits) + (1 << subBits);
+
+		return ((top + 1) << shift) - 1;
+	}
+
+	std::atomic<uint64_t> buckets[numBuckets];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> largest;
+};
+
+/* Times processing cycles against the time their frames take to play: a
+ * cycle that computes frames frames at rate has frames / rate seconds, or
+ * the device runs dry. Keeps a histogram of the cycle times and counts the
+ * cycles that missed their deadline. What the tail of the histogram looks
+ * like, against the deadline, says how much buffering the graph needs. */
+class DeadlineMonitor
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	DeadlineMonitor(int rate)
+		: rate(rate), numMisses(0), lastFrames(0)
+	{ }
+
+	/* Times one cycle, from construction to done() */
+	class Cycle
+	{
+	public:
+		Cycle(DeadlineMonitor& monitor)
+			: monitor(monitor), start(Clock::now())
+		{ }
+
+		void done(size_t frames)
+		{
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+			monitor.record(ns, frames);
+		}
+
+	private:
+		DeadlineMonitor& monitor;
+		Clock::time_point start;
+	};
+
+	void record(uint64_t ns, size_t frames)
+	{
+		histogram.record(ns);
+		lastFrames.store(frames, std::memory_order_relaxed);
+
+		if (ns > deadline(frames))
+		{
+			numMisses.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	/* What a cycle of frames frames has, in nanoseconds */
+	uint64_t deadline(size_t frames) const { return frames * 1000000000ull / rate; }
+
+	const LatencyHistogram& cycles() const { return histogram; }
+	uint64_t misses() const { return numMisses.load(std::memory_order_relaxed); }
+
+	void reset()
+	{
+		histogram.reset();
+		numMisses.store(0, std::memory_order_relaxed);
+	}
+
+	/* One line: the percentiles, in ms and against the last cycle's deadline */
+	void report(std::ostream& out) const
+	{
+		size_t frames = lastFrames.load(std::memory_order_relaxed);
+		double limit = deadline(frames);
+
+		auto ms = [&out] (uint64_t ns) -> std::ostream& { return out << std::setprecision(3) << ns / 1e6 << " ms"; };
+
+		out << std::fixed << histogram.count() << " cycles, deadline ";
+		ms(limit) << " per " << frames << " frames: p50 ";
+		ms(histogram.percentile(.5)) << ", p99 ";
+		ms(histogram.percentile(.99)) << ", p99.9 ";
+		ms(histogram.percentile(.999)) << ", max ";
+		ms(histogram.max()) << " (" << std::setprecision(1)
+				<< (limit > 0 ? 100 * histogram.max() / limit : 0) << "% of the deadline), "
+				<< misses() << " missed\n" << std::defaultfloat << std::setprecision(6);
+	}
+
+private:
+	int rate;
+	LatencyHistogram histogram;
+	std::atomic<uint64_t> numMisses;
+	std::atomic<size_t> lastFrames;
+};
+
+#endif /* DEADLINE_H_ */
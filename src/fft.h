@@ -0,0 +1,331 @@
+/*
+ * fft.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <complex>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+
+#include "simd.h"
+
+/* Plain complex multiply. std::complex's operator* goes through the C99
+ * Annex G inf/NaN recovery path (a library call) unless -ffast-math is on. */
+template <typename T>
+inline std::complex<T> complexMul(const std::complex<T>& a, const std::complex<T>& b)
+{
+	return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(),
+			a.real() * b.imag() + a.imag() * b.real());
+}
+
+/* In-place iterative radix-2 complex FFT. Size must be a power of two. */
+template <typename T>
+class Fft
+{
+public:
+	Fft(size_t n)
+		: n(n), twiddles(n / 2), bitReverse(n)
+	{
+		if (n == 0 || (n & (n - 1)) != 0)
+		{
+			throw std::invalid_argument("FFT size must be a power of two");
+		}
+
+		for (size_t i = 0; i < n / 2; i++)
+		{
+			twiddles[i] = std::polar<T>(1, -2 * M_PI * i / n);
+		}
+
+		int bits = 0;
+		while (((size_t) 1 << bits) < n)
+		{
+			bits++;
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t r = 0;
+			for (int b = 0; b < bits; b++)
+			{
+				r |= ((i >> b) & 1) << (bits - 1 - b);
+			}
+			bitReverse[i] = r;
+		}
+	}
+
+	void forward(std::complex<T>* data) const { transform(data, false); }
+
+	/* Unscaled: inverse(forward(x)) == n * x */
+	void inverse(std::complex<T>* data) const { transform(data, true); }
+
+	size_t size() const { return n; }
+
+private:
+	void transform(std::complex<T>* data, bool inverse) const
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i < bitReverse[i])
+			{
+				std::swap(data[i], data[bitReverse[i]]);
+			}
+		}
+
+		for (size_t len = 2; len <= n; len <<= 1)
+		{
+			size_t half = len / 2;
+			size_t step = n / len;
+
+			for (size_t i = 0; i < n; i += len)
+			{
+				for (size_t j = 0; j < half; j++)
+				{
+					std::complex<T> w = twiddles[j * step];
+					if (inverse)
+					{
+						w = std::conj(w);
+					}
+
+					std::complex<T> a = data[i + j];
+					std::complex<T> b = complexMul(data[i + j + half], w);
+
+					data[i + j] = a + b;
+					data[i + j + half] = a - b;
+				}
+			}
+		}
+	}
+
+	size_t n;
+	std::vector<std::complex<T>> twiddles;
+	std::vector<size_t> bitReverse;
+};
+
+/* Real FFT of size n, computed with a complex FFT of size n / 2.
+ * The spectrum holds the n / 2 + 1 non-redundant bins. */
+template <typename T>
+class RealFft
+{
+public:
+	RealFft(size_t n)
+		: n(n), fft(n / 2), twiddles(n / 2 + 1), work(n / 2)
+	{
+		if (n < 4)
+		{
+			throw std::invalid_argument("Real FFT size must be at least 4");
+		}
+
+		for (size_t k = 0; k <= n / 2; k++)
+		{
+			twiddles[k] = std::polar<T>(1, -2 * M_PI * k / n);
+		}
+	}
+
+	void forward(const T* in, std::complex<T>* out)
+	{
+		size_t m = n / 2;
+
+		for (size_t i = 0; i < m; i++)
+		{
+			work[i] = std::complex<T>(in[2 * i], in[2 * i + 1]);
+		}
+
+		fft.forward(work.data());
+
+		for (size_t k = 0; k <= m; k++)
+		{
+			std::complex<T> z = work[k == m ? 0 : k];
+			std::complex<T> zc = std::conj(work[k == 0 ? 0 : m - k]);
+
+			std::complex<T> even = (z + zc) * (T) 0.5;
+			std::complex<T> odd = complexMul(z - zc, std::complex<T>(0, -0.5));
+
+			out[k] = even + complexMul(odd, twiddles[k]);
+		}
+	}
+
+	/* Unscaled: inverse(forward(x)) == (n / 2) * x */
+	void inverse(const std::complex<T>* in, T* out)
+	{
+		size_t m = n / 2;
+
+		for (size_t k = 0; k < m; k++)
+		{
+			std::complex<T> x = in[k];
+			std::complex<T> xc = std::conj(in[m - k]);
+
+			std::complex<T> even = x + xc;
+			std::complex<T> odd = complexMul(x - xc, std::conj(twiddles[k]));
+
+			work[k] = (even + std::complex<T>(-odd.imag(), odd.real())) * (T) 0.5;
+		}
+
+		fft.inverse(work.data());
+
+		for (size_t i = 0; i < m; i++)
+		{
+			out[2 * i] = work[i].real();
+			out[2 * i + 1] = work[i].imag();
+		}
+	}
+
+	size_t size() const { return n; }
+
+private:
+	size_t n;
+	Fft<T> fft;
+	std::vector<std::complex<T>> twiddles;
+	std::vector<std::complex<T>> work;
+};
+
+/* Zero-latency uniformly partitioned convolution.
+ *
+ * The first partition of the impulse response is applied in the time domain,
+ * the remaining partitions with overlap-save in the frequency domain. The tail
+ * only needs input from previous blocks, so its output for a block can be
+ * computed as soon as the block before it is complete. The result is the plain
+ * linear convolution of the input with the taps, sample for sample, without
+ * any added delay. */
+template <typename T>
+class PartitionedConvolver
+{
+public:
+	PartitionedConvolver(const std::vector<T>& taps, size_t blockSize = 0)
+		: blockSize(blockSize ? blockSize : defaultBlockSize(taps.size())),
+		  head(taps.rend() - std::min(taps.size(), this->blockSize), taps.rend()),
+		  fft(this->blockSize * 2),
+		  history(this->blockSize * 2),
+		  tailOut(this->blockSize),
+		  timeBuf(this->blockSize * 2),
+		  accumulator(this->blockSize + 1),
+		  pos(0), fdlPos(0)
+	{
+		size_t bins = this->blockSize + 1;
+		size_t tailLen = taps.size() > this->blockSize ? taps.size() - this->blockSize : 0;
+		size_t partitions = (tailLen + this->blockSize - 1) / this->blockSize;
+
+		/* Fold the inverse transform's scaling into the filter spectra */
+		T scale = (T) 1 / this->blockSize;
+
+		filters.resize(partitions * bins);
+		fdl.resize(partitions * bins);
+
+		for (size_t p = 0; p < partitions; p++)
+		{
+			std::fill(timeBuf.begin(), timeBuf.end(), 0);
+
+			auto start = taps.begin() + this->blockSize * (p + 1);
+			auto end = std::min(start + this->blockSize, taps.end());
+			std::transform(start, end, timeBuf.begin(), [scale] (T x) { return x * scale; });
+
+			fft.forward(timeBuf.data(), &filters[p * bins]);
+		}
+	}
+
+	/* Convolve n input samples into n output samples */
+	void process(const T* in, T* out, size_t n)
+	{
+		while (n > 0)
+		{
+			size_t m = std::min(n, blockSize - pos);
+
+			T* newest = &history[blockSize + pos];
+			std::copy(in, in + m, newest);
+
+			firBlock(head.data(), head.size(), newest + 1 - head.size(), out, m);
+			for (size_t i = 0; i < m; i++)
+			{
+				out[i] += tailOut[pos + i];
+			}
+
+			in += m;
+			out += m;
+			n -= m;
+
+			pos += m;
+			if (pos == blockSize)
+			{
+				pos = 0;
+				computeTail();
+			}
+		}
+	}
+
+	size_t getBlockSize() const { return blockSize; }
+
+	/* Picks a partition size that balances the direct-form head against the
+	 * number of frequency-domain partitions (roughly sqrt(3 * numTaps)) */
+	static size_t defaultBlockSize(size_t numTaps)
+	{
+		size_t b = 16;
+		while (b * b < numTaps * 3 && b < 1024)
+		{
+			b <<= 1;
+		}
+
+		return b;
+	}
+
+private:
+	void computeTail()
+	{
+		size_t bins = blockSize + 1;
+		size_t partitions = filters.size() / bins;
+
+		if (partitions > 0)
+		{
+			fft.forward(history.data(), &fdl[fdlPos * bins]);
+
+			std::fill(accumulator.begin(), accumulator.end(), 0);
+
+			/* The spectrum of the block that just completed meets the first
+			 * tail partition, older blocks meet the later ones */
+			size_t slot = fdlPos;
+			for (size_t p = 0; p < partitions; p++)
+			{
+				const std::complex<T>* x = &fdl[slot * bins];
+				const std::complex<T>* h = &filters[p * bins];
+
+				for (size_t k = 0; k < bins; k++)
+				{
+					accumulator[k] += complexMul(x[k], h[k]);
+				}
+
+				slot = slot == 0 ? partitions - 1 : slot - 1;
+			}
+
+			fft.inverse(accumulator.data(), timeBuf.data());
+			std::copy(timeBuf.begin() + blockSize, timeBuf.end(), tailOut.begin());
+
+			if (++fdlPos == partitions)
+			{
+				fdlPos = 0;
+			}
+		}
+
+		/* The completed block becomes the previous block */
+		std::copy(history.begin() + blockSize, history.end(), history.begin());
+	}
+
+	size_t blockSize;
+	std::vector<T> head; /* First partition, reversed to run oldest to newest */
+	RealFft<T> fft;
+	std::vector<T> history;
+	std::vector<T> tailOut;
+	std::vector<T> timeBuf;
+	std::vector<std::complex<T>> accumulator;
+	std::vector<std::complex<T>> filters;
+	std::vector<std::complex<T>> fdl;
+	size_t pos;
+	size_t fdlPos;
+};
+
+#endif /* FFT_H_ */
@@ -0,0 +1,46 @@
+/*
+ * firdesign.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef FIRDESIGN_H_
+#define FIRDESIGN_H_
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+/* Blackman-windowed sinc low-pass with unity gain at DC.
+ * cutoff is in cycles per sample (0 < cutoff < 0.5). */
+template <typename T>
+std::vector<T> designLowPass(size_t numTaps, double cutoff)
+{
+	std::vector<T> taps(numTaps);
+
+	double center = (numTaps - 1) / 2.0;
+	double sum = 0;
+
+	for (size_t i = 0; i < numTaps; i++)
+	{
+		double x = i - center;
+		double sinc = x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+
+		double window = numTaps == 1 ? 1 :
+				0.42 - 0.5 * cos(2 * M_PI * i / (numTaps - 1))
+				+ 0.08 * cos(4 * M_PI * i / (numTaps - 1));
+
+		taps[i] = sinc * window;
+		sum += taps[i];
+	}
+
+	for (auto& x: taps)
+	{
+		x /= sum;
+	}
+
+	return taps;
+}
+
+#endif /* FIRDESIGN_H_ */
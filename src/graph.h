@@ -0,0 +1,554 @@
+/*
+ * graph.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include <iomanip>
+#include <string>
+#include <cstdint>
+
+#include "nodes.h"
+#include "threadpool.h"
+
+/* Splits a set of channels into groups with independent upstream graphs,
+ * which can be pulled at the same time.
+ *
+ * A block stays valid only until its node is pulled for the next one, so two
+ * consumers of the same node output can't be allowed to run ahead of each
+ * other: channels whose graphs consume an output through different
+ * DataChannels end up in the same group, and are pulled one after another.
+ * Reaching a node through the same DataChannel is fine. It is only pulled from
+ * inside the node that owns it, and that node's lock keeps the two sides apart. */
+class Branches
+{
+public:
+	Branches(const std::vector<Node::Input>& channels)
+	{
+		/* Every channel starts a group of its own, merging with
+		 * the groups it turns out to conflict with */
+		for (size_t i = 0; i < channels.size(); i++)
+		{
+			Consumers consumers;
+			collect(channels[i], consumers);
+
+			std::vector<size_t> members = {i};
+			for (size_t g = 0; g < groups.size(); )
+			{
+				if (conflict(consumers, reached[g]))
+				{
+					members.insert(members.end(), groups[g].begin(), groups[g].end());
+					for (auto& x: reached[g])
+					{
+						consumers[x.first].insert(x.second.begin(), x.second.end());
+					}
+
+					groups.erase(groups.begin() + g);
+					reached.erase(reached.begin() + g);
+				}
+				else
+				{
+					g++;
+				}
+			}
+
+			std::sort(members.begin(), members.end());
+			groups.push_back(members);
+			reached.push_back(std::move(consumers));
+		}
+	}
+
+	size_t size() const { return groups.size(); }
+
+	/* The channels in group g */
+	const std::vector<size_t>& operator[](size_t g) const { return groups[g]; }
+
+	/* Whether group g is the only one that reads a node's channel */
+	bool owns(size_t g, Node* node, int channel) const
+	{
+		std::pair<Node*, int> output = {node, node->outputOf(channel)};
+
+		for (size_t i = 0; i < reached.size(); i++)
+		{
+			if (i != g && reached[i].count(output))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	/* The DataChannels (channel, consumer) found on each node output */
+	typedef std::map<std::pair<Node*, int>, std::set<std::pair<int, int>>> Consumers;
+
+	static void collect(Node::Input input, Consumers& consumers)
+	{
+		auto& found = consumers[{input.node, input.node->outputOf(input.channel)}];
+		if (!found.insert({input.channel, input.consumer}).second)
+		{
+			return;
+		}
+
+		for (auto& x: input.node->inputs())
+		{
+			collect(x, consumers);
+		}
+	}
+
+	static bool conflict(const Consumers& a, const Consumers& b)
+	{
+		for (auto& x: a)
+		{
+			auto it = b.find(x.first);
+			if (it == b.end())
+			{
+				continue;
+			}
+
+			std::set<std::pair<int, int>> both(x.second);
+			both.insert(it->second.begin(), it->second.end());
+
+			if (both.size() > 1)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	std::vector<std::vector<size_t>> groups;
+	std::vector<Consumers> reached;
+};
+
+/* Pulls a sink's channels, running the independent ones (see Branches) at
+ * the same time on a thread pool and joining before it returns */
+template <typename T>
+class BranchScheduler
+{
+public:
+	BranchScheduler(std::vector<DataChannel<T>*> dataChannels,
+			std::shared_ptr<ThreadPool> pool = nullptr)
+		: dataChannels(dataChannels), pool(pool), branches(inputsOf(dataChannels)),
+		  target(nullptr), frames(0)
+	{ }
+
+	/* Pulls the next frames frames of every channel into views */
+	void pull(DataView<T>* views, size_t frames)
+	{
+		if (!pool || branches.size() < 2)
+		{
+			for (size_t i = 0; i < dataChannels.size(); i++)
+			{
+				views[i] = dataChannels[i]->getView(frames);
+			}
+
+			return;
+		}
+
+		/* The calling thread takes the first group itself. The tasks find views
+		 * and frames in members: a lambda that small fits in the std::function
+		 * as is, where a bigger one would be allocated. */
+		target = views;
+		this->frames = frames;
+		for (size_t g = 1; g < branches.size(); g++)
+		{
+			pool->run(tasks, [this, g] { pullGroup(g, target); });
+		}
+
+		/* The tasks write to views, so they have to be done before an
+		 * exception of our own group leaves here */
+		try
+		{
+			pullGroup(0, views);
+		}
+		catch (...)
+		{
+			pool->drain(tasks);
+			throw;
+		}
+
+		pool->wait(tasks);
+	}
+
+	/* Number of channel groups that can run at the same time */
+	size_t numBranches() const { return branches.size(); }
+
+private:
+	static std::vector<Node::Input> inputsOf(const std::vector<DataChannel<T>*>& dataChannels)
+	{
+		std::vector<Node::Input> res;
+		for (auto* dataChannel: dataChannels)
+		{
+			res.push_back(dataChannel->input());
+		}
+
+		return res;
+	}
+
+	void pullGroup(size_t g, DataView<T>* views)
+	{
+		for (size_t i: branches[g])
+		{
+			views[i] = dataChannels[i]->getView(frames);
+		}
+	}
+
+	std::vector<DataChannel<T>*> dataChannels;
+	std::shared_ptr<ThreadPool> pool;
+	Branches branches;
+	ThreadPool::TaskGroup tasks;
+	DataView<T>* target;
+	size_t frames;
+};
+
+/* A graph compiled into flat process lists.
+ *
+ * Pulling a sink's channels walks the graph recursively, every cycle. A Graph
+ * sorts the nodes once, inputs before the nodes that read them, and each cycle
+ * computes the next block of every channel in that order. By the time a node
+ * runs, its inputs are ready and memoized: its pulls are cache hits instead of
+ * recursion, and the sinks' pulls only collect the results. Channels that still
+ * hold an unread block are skipped.
+ *
+ * The sinks ask for a number of frames per cycle, and every node is computed
+ * with what its consumers will ask of it: the same, or a multiple of it for
+ * inputs of nodes that take interleaved frames apart (see
+ * Node::inputRatio()). What's upstream of a DataBuffer is pulled on demand.
+ *
+ * Independent branches get a process list of their own, and run in parallel
+ * when the graph has a pool. Channels that more than one branch reads are left
+ * to be pulled on demand, under the lock of the node that reads them, and so
+ * are nodes that forward their inputs' blocks. */
+class Graph
+{
+public:
+	Graph(std::shared_ptr<ThreadPool> pool = nullptr)
+		: pool(pool), maxFrames(0), frames(0), cycles(0), checkAfter(UINT64_MAX)
+	{ }
+
+	/* Nodes that are expected to be part of the graph. Everything upstream
+	 * of the outputs is included anyway, but nodes added here that don't
+	 * feed any output make compile() fail. */
+	void add(std::initializer_list<std::shared_ptr<Node>> nodes)
+	{
+		for (auto& node: nodes)
+		{
+			added.push_back(node);
+		}
+	}
+
+	/* A channel that's read from outside the graph, by a sink */
+	void addOutput(Node::Input output) { outputs.push_back(output); }
+
+	/* Sorts the graph, and reserves the pool blocks its nodes keep, big enough
+	 * for run() to be asked for up to maxFrames frames. Throws
+	 * std::invalid_argument if it has a cycle, an added node that doesn't
+	 * feed any output, or a node whose consumers would ask it for blocks of
+	 * different sizes. */
+	void compile(size_t maxFrames)
+	{
+		std::map<Node*, int> state;
+		for (auto& output: outputs)
+		{
+			visit(output.node, state);
+		}
+
+		for (auto& node: added)
+		{
+			if (!state.count(node.get()))
+			{
+				throw std::invalid_argument("Graph has a node that isn't connected to any output");
+			}
+		}
+
+		branches = std::make_unique<Branches>(outputs);
+		schedules.assign(branches->size(), {});
+		ratios.assign(branches->size(), {});
+		nodes.clear();
+
+		/* Nodes in dependency order, and the channels that are read of each */
+		std::vector<std::vector<Node*>> orders(branches->size());
+		std::vector<std::map<Node*, std::set<int>>> reads(branches->size());
+		std::set<Node*> listed;
+
+		for (size_t g = 0; g < branches->size(); g++)
+		{
+			std::set<Node*> seen;
+
+			for (size_t i: (*branches)[g])
+			{
+				reads[g][outputs[i].node].insert(outputs[i].channel);
+				topologicalSort(outputs[i].node, orders[g], reads[g], seen);
+			}
+
+			for (auto* node: orders[g])
+			{
+				if (listed.insert(node).second)
+				{
+					nodes.push_back(node);
+				}
+			}
+		}
+
+		auto ratio = frameRatios();
+
+		for (size_t g = 0; g < branches->size(); g++)
+		{
+			for (auto* node: orders[g])
+			{
+				for (int channel: reads[g][node])
+				{
+					if (!node->forwardsViews() && ratio[node] > 0 && branches->owns(g, node, channel))
+					{
+						schedules[g].push_back({node, channel, -1});
+						ratios[g].push_back(ratio[node]);
+					}
+				}
+			}
+		}
+
+		/* The largest block: that of what's read in the most frames at a time.
+		 * What's pulled on demand (behind a DataBuffer) isn't known here. */
+		size_t largest = 1;
+		for (auto& x: ratio)
+		{
+			largest = std::max(largest, x.second);
+		}
+
+		this->maxFrames = maxFrames;
+
+		for (auto* node: nodes)
+		{
+			node->reserveBlocks(maxFrames * largest);
+		}
+	}
+
+	/* Computes the next block of every channel that's due, for sinks that
+	 * will ask for frames frames. Once every node has seen a few blocks of
+	 * that size, this doesn't allocate anymore; see checkAllocations() to
+	 * make sure. Throws std::invalid_argument past what the graph was
+	 * compiled for. */
+	void run(size_t frames)
+	{
+		if (frames > maxFrames)
+		{
+			throw std::invalid_argument("Graph compiled for up to " + std::to_string(maxFrames)
+					+ " frames, asked for " + std::to_string(frames));
+		}
+
+		AllocationFreeScope scope;
+
+		if (++cycles == checkAfter)
+		{
+			checkAllocations() = true;
+		}
+
+		/* A member, like BranchScheduler's views */
+		this->frames = frames;
+
+		if (!pool || schedules.size() < 2)
+		{
+			for (size_t g = 0; g < schedules.size(); g++)
+			{
+				runSchedule(g);
+			}
+
+			return;
+		}
+
+		for (size_t g = 1; g < schedules.size(); g++)
+		{
+			pool->run(tasks, [this, g] { runSchedule(g); });
+		}
+
+		try
+		{
+			runSchedule(0);
+		}
+		catch (...)
+		{
+			pool->drain(tasks);
+			throw;
+		}
+
+		pool->wait(tasks);
+	}
+
+	/* Turns checkAllocations() on after warmup more cycles, by when every
+	 * node should have all the memory it's ever going to need */
+	void checkAllocationsAfter(uint64_t warmup) { checkAfter = cycles + warmup; }
+
+	size_t numBranches() const { return schedules.size(); }
+
+	/* The process list of a branch, as (node, channel) pairs */
+	const std::vector<Node::Input>& schedule(size_t branch) const { return schedules[branch]; }
+
+	/* Every node of the compiled graph, inputs before the nodes that read them */
+	const std::vector<Node*>& allNodes() const { return nodes; }
+
+	/* Writes what every node cost so far, see profiling() */
+	void report(std::ostream& out) const
+	{
+		uint64_t total = 0;
+		for (auto* node: nodes)
+		{
+			total += node->profile().nanoseconds;
+		}
+
+		out << std::left << std::setw(40) << "node" << std::right
+				<< std::setw(10) << "calls" << std::setw(12) << "samples"
+				<< std::setw(10) << "total ms" << std::setw(10) << "mean us"
+				<< std::setw(10) << "max us" << std::setw(11) << "ns/sample"
+				<< std::setw(8) << "allocs" << std::setw(7) << "share" << '\n';
+
+		for (auto* node: nodes)
+		{
+			auto& p = node->profile();
+			uint64_t calls = p.calls, samples = p.samples, ns = p.nanoseconds;
+
+			out << std::left << std::setw(40) << node->name().substr(0, 39) << std::right << std::fixed
+					<< std::setw(10) << calls << std::setw(12) << samples
+					<< std::setprecision(2) << std::setw(10) << ns / 1e6
+					<< std::setw(10) << (calls ? ns / 1e3 / calls : 0)
+					<< std::setw(10) << p.maxNanoseconds / 1e3
+					<< std::setw(11) << (samples ? (double) ns / samples : 0)
+					<< std::setw(8) << p.allocations
+					<< std::setprecision(1) << std::setw(6) << (total ? 100.0 * ns / total : 0) << "%\n";
+		}
+
+		out << std::defaultfloat << std::setprecision(6) << "total " << total / 1e6 << " ms, "
+				<< totalAllocations() << " heap allocations since start"
+				<< (profiling() ? "" : " (profiling is off)") << '\n';
+	}
+
+	void resetProfile()
+	{
+		for (auto* node: nodes)
+		{
+			node->resetProfile();
+		}
+	}
+
+private:
+	/* Depth first search for cycles */
+	static void visit(Node* node, std::map<Node*, int>& state)
+	{
+		enum { visiting = 1, done = 2 };
+
+		auto it = state.find(node);
+		if (it != state.end())
+		{
+			if (it->second == visiting)
+			{
+				throw std::invalid_argument("Graph has a cycle");
+			}
+
+			return;
+		}
+
+		state[node] = visiting;
+
+		for (auto& x: node->inputs())
+		{
+			visit(x.node, state);
+		}
+
+		state[node] = done;
+	}
+
+	/* Post-order: every node comes after its inputs */
+	static void topologicalSort(Node* node, std::vector<Node*>& order,
+			std::map<Node*, std::set<int>>& read, std::set<Node*>& seen)
+	{
+		if (!seen.insert(node).second)
+		{
+			return;
+		}
+
+		for (auto& x: node->inputs())
+		{
+			read[x.node].insert(x.channel);
+			topologicalSort(x.node, order, read, seen);
+		}
+
+		order.push_back(node);
+	}
+
+	/* Frames of every node per frame of the outputs: 1 unless a reader takes
+	 * interleaved frames apart, 0 for what's only pulled on demand. A node
+	 * that's also read by something that pulls on demand (like a DataBuffer)
+	 * is still computed ahead for its other readers. Nodes come after their
+	 * inputs in nodes, so walking it backwards finds every node's readers
+	 * first. */
+	std::map<Node*, size_t> frameRatios() const
+	{
+		std::map<Node*, size_t> ratio;
+
+		auto set = [&ratio] (Node* node, size_t r)
+		{
+			auto it = ratio.emplace(node, r).first;
+			if (it->second == 0)
+			{
+				it->second = r;
+			}
+			else if (r != 0 && it->second != r)
+			{
+				throw std::invalid_argument("Graph has a node that's read in blocks of different sizes: " + node->name());
+			}
+		};
+
+		for (auto& output: outputs)
+		{
+			set(output.node, 1);
+		}
+
+		for (auto it = nodes.rbegin(); it != nodes.rend(); it++)
+		{
+			for (auto& x: (*it)->inputs())
+			{
+				set(x.node, ratio[*it] * (*it)->inputRatio());
+			}
+		}
+
+		return ratio;
+	}
+
+	void runSchedule(size_t g)
+	{
+		AllocationFreeScope scope;
+
+		for (size_t i = 0; i < schedules[g].size(); i++)
+		{
+			schedules[g][i].node->prefetch(schedules[g][i].channel, frames * ratios[g][i]);
+		}
+	}
+
+	std::shared_ptr<ThreadPool> pool;
+	std::vector<std::shared_ptr<Node>> added;
+	std::vector<Node::Input> outputs;
+	std::unique_ptr<Branches> branches;
+	std::vector<std::vector<Node::Input>> schedules;
+	std::vector<std::vector<size_t>> ratios;	/* Of every channel in schedules */
+	std::vector<Node*> nodes;
+	ThreadPool::TaskGroup tasks;
+	size_t maxFrames;
+	size_t frames;
+	uint64_t cycles;
+	uint64_t checkAfter;
+};
+
+#endif /* GRAPH_H_ */
@@ -0,0 +1,87 @@
+/*
+ * mappedfile.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <string>
+#include <system_error>
+#include <cerrno>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* A file mapped read-only into memory. The pages come straight from the page
+ * cache and are read in on first touch, so opening even a multi-hour recording
+ * is instant and costs no private memory. */
+class MappedFile
+{
+public:
+	MappedFile(const std::string& filename)
+		: ptr(nullptr), length(0)
+	{
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw std::system_error(errno, std::generic_category(), filename);
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			int err = errno;
+			close(fd);
+			throw std::system_error(err, std::generic_category(), filename);
+		}
+
+		length = st.st_size;
+
+		/* An empty file can't be mapped, and doesn't need to be */
+		if (length > 0)
+		{
+			void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED)
+			{
+				int err = errno;
+				close(fd);
+				throw std::system_error(err, std::generic_category(), filename);
+			}
+
+			ptr = static_cast<const char*>(p);
+
+			/* Reading front to back: have the kernel read ahead aggressively
+			 * and drop the pages behind us first */
+			madvise(const_cast<char*>(ptr), length, MADV_SEQUENTIAL);
+		}
+
+		/* The mapping keeps the file referenced */
+		close(fd);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		if (ptr)
+		{
+			munmap(const_cast<char*>(ptr), length);
+		}
+	}
+
+	const char* data() const { return ptr; }
+	size_t size() const { return length; }
+
+private:
+	const char* ptr;
+	size_t length;
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,2027 @@
+/*
+ * nodes.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef NODES_H_
+#define NODES_H_
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <mutex>
+#include <typeinfo>
+#include <stdexcept>
+
+#include "fft.h"
+#include "simd.h"
+#include "firdesign.h"
+#include "mappedfile.h"
+#include "convert.h"
+#include "oscillator.h"
+#include "biquad.h"
+#include "noise.h"
+#include "profile.h"
+#include "blockpool.h"
+#include "audioblock.h"
+
+/* Read-only window on a block of samples. It points into memory owned by the
+ * node that produced it, and stays valid until that node is pulled again. */
+template <typename T>
+class DataView
+{
+public:
+	DataView()
+		: ptr(nullptr), frames(0)
+	{ }
+
+	DataView(const T* data, size_t frames)
+		: ptr(data), frames(frames)
+	{ }
+
+	DataView(const std::vector<T>& vector)
+		: ptr(vector.data()), frames(vector.size())
+	{ }
+
+	const T* data() const { return ptr; }
+	size_t size() const { return frames; }
+	bool empty() const { return frames == 0; }
+
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + frames; }
+
+	const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+	const T* ptr;
+	size_t frames;
+};
+
+/* The type-independent side of a stream, for walking the graph */
+class Node
+{
+public:
+	struct Input
+	{
+		Node* node;
+		int channel;
+		int consumer;
+	};
+
+	/* The channels this node pulls from */
+	virtual std::vector<Input> inputs() const { return {}; }
+
+	/* The output a channel reads. Nodes whose channels all hand out
+	 * the same stream to different consumers map them onto one. */
+	virtual int outputOf(int channel) const { return channel; }
+
+	/* Whether getView() may hand out an input's block instead of the node's
+	 * own. Those are only valid for as long as the input's block is, so they
+	 * must be read right away and can't be computed ahead. */
+	virtual bool forwardsViews() const { return false; }
+
+	/* Computes a channel's next block, of frames frames, ahead of its consumers */
+	virtual bool prefetch(int channel, size_t frames) = 0;
+
+	/* Frames of every input a block takes per frame it has: more than one for
+	 * nodes that take interleaved frames apart, 0 for nodes that pull their
+	 * inputs in blocks of a size of their own (DataBuffer) */
+	virtual size_t inputRatio() const { return 1; }
+
+	/* How many frames the output lags the input by, like a filter's group
+	 * delay. Paths that are mixed again have to be delayed to match (see
+	 * DelayLine). */
+	virtual size_t latency() const { return 0; }
+
+	/* Adds the blocks this node keeps between pulls to BlockPool::shared(),
+	 * so that they don't get allocated while the graph runs, and makes them
+	 * hold at least frames samples: the largest block any node of the graph
+	 * hands out. Called by Graph::compile(), once the consumers are connected. */
+	virtual void reserveBlocks(size_t frames) { }
+
+	/* For reports. Defaults to the node's type. */
+	std::string name() const { return label.empty() ? demangle(typeid(*this).name()) : label; }
+	void setName(const std::string& name) { label = name; }
+
+	/* What computing this node's blocks took so far, while profiling() was on */
+	const NodeProfile& profile() const { return stats; }
+	void resetProfile() { stats.reset(); }
+
+	virtual ~Node() { }
+
+protected:
+	NodeProfile stats;
+
+private:
+	std::string label;
+};
+
+/* Read-only window on every stride'th sample, e.g. one channel of
+ * interleaved data, without copying anything */
+template <typename T>
+class StridedView
+{
+public:
+	StridedView(const T* data, size_t frames, size_t stride)
+		: ptr(data), frames(frames), stride(stride)
+	{ }
+
+	size_t size() const { return frames; }
+	bool empty() const { return frames == 0; }
+
+	const T& operator[](size_t i) const { return ptr[i * stride]; }
+
+private:
+	const T* ptr;
+	size_t frames;
+	size_t stride;
+};
+
+/* A node's output. Consumers ask for the number of frames they want, and every
+ * node returns exactly that many: a node that lags, primes or runs out deals
+ * with it itself, with silence or with what it kept from before. The block
+ * sizes nodes take in their constructors are just what their buffers start
+ * out with. */
+template <typename T>
+class DataStream : public Node
+{
+public:
+	/* The next frames frames of channel */
+	virtual const std::vector<T>& getData(int channel, size_t frames) = 0;
+
+	/* The same block getData() returns, but without requiring the node to own it.
+	 * Nodes that only pass data on override this to hand out their input's view. */
+	virtual DataView<T> getView(int channel, size_t frames) { return getData(channel, frames); }
+
+	/* Memoized pull, used through DataChannel. Every block (epoch) of a channel is
+	 * computed once, when the first consumer asks for it, and every consumer of
+	 * that channel reads the very same block. Consumers that fall behind read
+	 * copies that are kept for them until they've caught up, so a stream can feed
+	 * any number of consumers without a Splitter.
+	 *
+	 * Consumers on different threads take turns: the lock is held while the
+	 * block is computed, so the others find it done when they get in.
+	 *
+	 * So all consumers of a channel read it in blocks of the same size. Asking
+	 * for another size than the block was computed with throws
+	 * std::logic_error.
+	 *
+	 * Consumers that haven't pulled yet hold back only so many blocks (see
+	 * minPosition()): once they do pull, they start at the oldest block that's
+	 * still around. */
+	DataView<T> pull(int channel, int consumer, size_t frames)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto& output = outputs[channel];
+		output.start(consumer);
+		uint64_t epoch = output.positions[consumer];
+
+		if (epoch == output.epoch)
+		{
+			bool kept = epoch > 0 && output.minPosition() < epoch;
+			if (kept)
+			{
+				output.keep();
+			}
+			else if (!output.history.empty())
+			{
+				output.retire(epoch - 1 - output.history.size());
+			}
+
+			try
+			{
+				output.current = compute(channel, frames);
+			}
+			catch (...)
+			{
+				if (kept)
+				{
+					output.unkeep();
+				}
+
+				throw;
+			}
+
+			output.epoch++;
+			output.positions[consumer]++;
+
+			return output.current;
+		}
+
+		if (epoch + 1 == output.epoch)
+		{
+			auto view = checked(output.current, frames);
+			output.positions[consumer]++;
+
+			return view;
+		}
+
+		uint64_t first = output.epoch - 1 - output.history.size();
+		auto& copy = output.history[epoch - first];
+		auto view = checked(DataView<T>(copy.data(), copy.size()), frames);
+
+		output.positions[consumer]++;
+		output.retire(first);
+
+		return view;
+	}
+
+	/* Computes the next block of channel before anyone asks for it, so that the
+	 * consumers' pulls find it memoized. Does nothing while some consumer still
+	 * has to read the current block. */
+	bool prefetch(int channel, size_t frames) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (channel >= (int) outputs.size())
+		{
+			return false;
+		}
+
+		auto& output = outputs[channel];
+		uint64_t min = output.minPosition();
+
+		if (min == noConsumer || min < output.epoch)
+		{
+			return false;
+		}
+
+		output.current = compute(channel, frames);
+		output.epoch++;
+
+		return true;
+	}
+
+	/* Registers a consumer of channel, starting at the next block to be
+	 * computed, or at the same block as consumer from */
+	int connect(int channel, int from = -1)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (channel >= (int) outputs.size())
+		{
+			outputs.resize(channel + 1);
+		}
+
+		auto& output = outputs[channel];
+		uint64_t position = from < 0 ? output.epoch : output.positions[from];
+		bool started = from >= 0 && output.started[from];
+
+		auto it = std::find(output.positions.begin(), output.positions.end(), noConsumer);
+		if (it != output.positions.end())
+		{
+			*it = position;
+			output.started[it - output.positions.begin()] = started;
+
+			return it - output.positions.begin();
+		}
+
+		output.positions.push_back(position);
+		output.started.push_back(started);
+
+		return output.positions.size() - 1;
+	}
+
+	void disconnect(int channel, int consumer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		outputs[channel].positions[consumer] = noConsumer;
+		outputs[channel].started[consumer] = false;
+	}
+
+	/* Room for the copies kept for consumers that fall behind: two blocks for
+	 * every consumer but the first, which covers a consumer that's one block
+	 * out of step (like behind a DataBuffer). More get drawn from the pool, the
+	 * first time they're needed. The spares go back, as they may be of a size
+	 * from before fit(). */
+	void reserveBlocks(size_t frames) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		BlockPool<T>::shared().fit(frames);
+
+		size_t blocks = blocksNeeded();
+		for (auto& output: outputs)
+		{
+			size_t consumers = std::count_if(output.positions.begin(), output.positions.end(),
+					[] (uint64_t x) { return x != noConsumer; });
+			size_t copies = consumers > 1 ? 2 * (consumers - 1) : 0;
+
+			output.spare.clear();
+			output.history.reserve(copies);
+			output.spare.reserve(copies);
+			blocks += copies;
+		}
+
+		BlockPool<T>::shared().reserve(blocks);
+	}
+
+	virtual ~DataStream() { }
+
+protected:
+	/* The pool blocks a node keeps of its own */
+	virtual size_t blocksNeeded() const { return 0; }
+
+private:
+	static constexpr uint64_t noConsumer = UINT64_MAX;
+	static constexpr uint64_t maxUnread = 64;	/* Blocks kept for consumers that haven't pulled yet */
+
+	DataView<T> compute(int channel, size_t frames)
+	{
+		if (!profiling().load(std::memory_order_relaxed))
+		{
+			return checked(getView(channel, frames), frames);
+		}
+
+		ProfileScope scope(this->stats);
+		DataView<T> view = getView(channel, frames);
+		scope.done(view.size());
+
+		return checked(view, frames);
+	}
+
+	DataView<T> checked(DataView<T> view, size_t frames) const
+	{
+		if (view.size() != frames)
+		{
+			throw std::logic_error(name() + ": " + std::to_string(frames) + " frames asked for, "
+					+ std::to_string(view.size()) + " handed out");
+		}
+
+		return view;
+	}
+
+	struct Output
+	{
+		uint64_t epoch = 0;		/* Number of blocks computed so far */
+		DataView<T> current;		/* Block epoch - 1 */
+		std::vector<uint64_t> positions;	/* Next block of each consumer */
+		std::vector<bool> started;	/* Whether each consumer has pulled yet */
+		std::vector<Block<T>> history;	/* Copies of the blocks before current, oldest first */
+		std::vector<Block<T>> spare;	/* Retired copies, for the next keep() */
+		Block<T> held;			/* A copy of current, after unkeep() */
+
+		/* The oldest block a consumer still has to read. Those that haven't
+		 * pulled yet may start late, behind a consumer that reads ahead (a
+		 * DataBuffer, a decimating filter), so their blocks are kept too, but
+		 * only the first maxUnread: past that they count as caught up, so a
+		 * channel that's connected but never read doesn't make every block be
+		 * kept. */
+		uint64_t minPosition() const
+		{
+			uint64_t min = noConsumer;
+			for (size_t i = 0; i < positions.size(); i++)
+			{
+				if (positions[i] != noConsumer)
+				{
+					bool idle = !started[i] && epoch - positions[i] > maxUnread;
+					min = std::min(min, idle ? epoch : positions[i]);
+				}
+			}
+
+			return min;
+		}
+
+		/* Moves a consumer that pulls for the first time up to the oldest block
+		 * that's still around */
+		void start(int consumer)
+		{
+			if (!started[consumer])
+			{
+				if (epoch > 0)
+				{
+					positions[consumer] = std::max(positions[consumer], epoch - 1 - history.size());
+				}
+
+				started[consumer] = true;
+			}
+		}
+
+		/* Copies the current block for the consumers that haven't read it yet */
+		void keep()
+		{
+			if (held.data() && held.data() == current.data())
+			{
+				history.push_back(std::move(held));
+				return;
+			}
+
+			Block<T> copy;
+			if (spare.empty())
+			{
+				copy = Block<T>(BlockPool<T>::shared());
+			}
+			else
+			{
+				copy = std::move(spare.back());
+				spare.pop_back();
+			}
+
+			copy.assign(current.begin(), current.end());
+			history.push_back(std::move(copy));
+		}
+
+		/* Takes back the last keep(), when the block after it couldn't be
+		 * computed. Trying may have overwritten what current points to, so it
+		 * points to the copy instead, until the next keep() puts it back. */
+		void unkeep()
+		{
+			held = std::move(history.back());
+			history.pop_back();
+			current = DataView<T>(held.data(), held.size());
+		}
+
+		/* Drops the copies every consumer is done with. They are kept as spares
+		 * rather than given back to the shared pool, where another node could
+		 * take them right away: this way the views handed out stay intact until
+		 * the next keep(). */
+		void retire(uint64_t first)
+		{
+			uint64_t min = minPosition();
+			size_t n = 0;
+			while (n < history.size() && first < min)
+			{
+				spare.push_back(std::move(history[n]));
+				n++;
+				first++;
+			}
+
+			history.erase(history.begin(), history.begin() + n);
+		}
+	};
+
+	std::vector<Output> outputs;
+	std::mutex mutex;
+};
+
+/* A consumer's connection to one channel of a stream. Every DataChannel is a
+ * consumer in its own right: a copy starts reading where the original is. */
+template <typename T>
+struct DataChannel
+{
+	DataChannel(std::shared_ptr<DataStream<T>> stream, int channel)
+		: stream(stream), channel(channel), consumer(stream->connect(channel))
+	{ }
+
+	DataChannel(const DataChannel& other)
+		: stream(other.stream), channel(other.channel),
+		  consumer(stream->connect(channel, other.consumer))
+	{ }
+
+	DataChannel& operator=(const DataChannel& other)
+	{
+		if (this != &other)
+		{
+			stream->disconnect(channel, consumer);
+
+			stream = other.stream;
+			channel = other.channel;
+			consumer = stream->connect(channel, other.consumer);
+		}
+
+		return *this;
+	}
+
+	~DataChannel()
+	{
+		stream->disconnect(channel, consumer);
+	}
+
+	/* This consumer's next frames frames */
+	DataView<T> getView(size_t frames) { return stream->pull(channel, consumer, frames); }
+
+	Node::Input input() const { return {stream.get(), channel, consumer}; }
+
+	std::shared_ptr<DataStream<T>> stream;
+	int channel;
+
+private:
+	int consumer;
+};
+
+/* FIFO on a power-of-two ring. The capacity only grows when a write doesn't
+ * fit, so it stops reallocating once the largest backlog has been seen. Reads
+ * and writes are at most two contiguous copies; nothing is ever shifted. */
+template <typename T>
+class RingBuffer
+{
+public:
+	RingBuffer(size_t capacity = 0)
+		: mask(0), readPos(0), writePos(0)
+	{
+		reserve(capacity);
+	}
+
+	void write(const T* data, size_t n)
+	{
+		reserve(size() + n);
+
+		size_t pos = writePos & mask;
+		size_t first = std::min(n, buf.size() - pos);
+
+		std::copy(data, data + first, buf.begin() + pos);
+		std::copy(data + first, data + n, buf.begin());
+
+		writePos += n;
+	}
+
+	void read(T* data, size_t n)
+	{
+		size_t pos = readPos & mask;
+		size_t first = std::min(n, buf.size() - pos);
+
+		std::copy(buf.begin() + pos, buf.begin() + pos + first, data);
+		std::copy(buf.begin(), buf.begin() + (n - first), data + first);
+
+		readPos += n;
+	}
+
+	void consume(size_t n) { readPos += n; }
+
+	/* The next n samples, or nullptr if they wrap around the end of the ring */
+	const T* peek(size_t n) const
+	{
+		size_t pos = readPos & mask;
+
+		return pos + n <= buf.size() ? &buf[pos] : nullptr;
+	}
+
+	/* Makes room for at least n samples */
+	void reserve(size_t n)
+	{
+		if (n <= buf.size() && !buf.empty())
+		{
+			return;
+		}
+
+		size_t capacity = 1;
+		while (capacity < n)
+		{
+			capacity <<= 1;
+		}
+
+		std::vector<T> newBuf(capacity);
+		size_t n0 = size();
+		read(newBuf.data(), n0);
+
+		buf = std::move(newBuf);
+		mask = capacity - 1;
+		readPos = 0;
+		writePos = n0;
+	}
+
+	size_t size() const { return writePos - readPos; }
+	size_t capacity() const { return buf.size(); }
+	bool empty() const { return readPos == writePos; }
+
+private:
+	std::vector<T> buf;
+	size_t mask;
+	/* Free-running; only the low bits index the ring */
+	size_t readPos;
+	size_t writePos;
+};
+
+/* Plays values over and over */
+template <typename T>
+class DumbSource: public DataStream<T>
+{
+public:
+	DumbSource(std::initializer_list<T> values)
+		: values(values), pos(0)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buffer.resize(frames);
+		for (size_t i = 0; i < frames; i++)
+		{
+			buffer[i] = values[pos];
+			pos = (pos + 1) % values.size();
+		}
+
+		return buffer;
+	}
+
+private:
+	std::vector<T> values;
+	size_t pos;
+	std::vector<T> buffer;
+};
+
+template <typename T>
+class FileReaderSoure : public DataStream<T>
+{
+public:
+	FileReaderSoure(std::string filename, size_t n = 1024)
+		: buf(n)
+	{
+		file = std::ifstream(filename, std::ios::binary);
+	}
+
+	/* Past the end, the file reads as silence */
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		size_t byteSize = frames * sizeof(T);
+
+		file.read((char *) buf.data(), byteSize);
+
+		size_t cnt = file.gcount();
+
+		if (cnt < byteSize)
+		{
+			std::fill(buf.begin() + cnt / sizeof(T), buf.end(), T());
+		}
+
+		return buf;
+	}
+
+private:
+	std::vector<T> buf;
+	std::ifstream file;
+};
+
+/* Raw PCM straight from a memory mapped file. Every channel of the file is a
+ * channel of the stream, read at its own pace. Mono files are handed out
+ * without copying anything: the blocks point into the mapping. Interleaved
+ * files are deinterleaved a block at a time, all channels in one pass through
+ * the vector kernels (see audioblock.h). */
+template <typename T>
+class MappedFileSource : public DataStream<T>
+{
+public:
+	MappedFileSource(std::string filename, int channels = 1, size_t n = 1024)
+		: file(filename), channels(channels),
+		  frames(file.size() / sizeof(T) / channels),
+		  positions(channels), reads(channels),
+		  blocks{AudioBlock<T>(channels, n), AudioBlock<T>(channels, n)},
+		  scratch(1, n), targets(channels)
+	{
+		for (auto& block: blocks)
+		{
+			block.setFrames(n);
+		}
+
+		ready[0].assign(channels, false);
+		ready[1].assign(channels, false);
+	}
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = getView(channel, frames);
+		buf.assign(data.begin(), data.end());
+
+		return buf;
+	}
+
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		size_t start = positions[channel];
+		size_t count = std::min(frames, this->frames - std::min(start, this->frames));
+
+		if (channels == 1 && count == frames)
+		{
+			positions[channel] += count;
+			return DataView<T>(samples() + start, count);
+		}
+
+		reserve(frames);
+
+		/* Channels read blocks into alternate halves of a double buffer, so
+		 * the one a channel's last view points into is left alone */
+		size_t b = reads[channel] % 2;
+		if (!ready[b][channel] || blocks[b].frames() != frames)
+		{
+			fill(b, start, frames);
+		}
+
+		ready[b][channel] = false;
+		reads[channel]++;
+		positions[channel] += frames;
+
+		return DataView<T>(blocks[b].channel(channel), frames);
+	}
+
+	/* Frames [start, start + count) of a channel, in place */
+	StridedView<T> strided(int channel, size_t start, size_t count) const
+	{
+		return StridedView<T>(samples() + start * channels + channel, count, channels);
+	}
+
+	size_t numFrames() const { return frames; }
+
+private:
+	const T* samples() const { return reinterpret_cast<const T*>(file.data()); }
+
+	/* Deinterleaves the n frames at start into half b of the buffer, in one
+	 * pass for every channel that reads that block next from that half:
+	 * normally all of them. The others' planes go to scratch. */
+	void fill(size_t b, size_t start, size_t n)
+	{
+		size_t count = std::min(n, frames - std::min(start, frames));
+
+		blocks[b].setFrames(n);
+		scratch.setFrames(n);
+
+		for (int c = 0; c < channels; c++)
+		{
+			bool inStep = reads[c] % 2 == b && positions[c] == start;
+
+			targets[c] = inStep ? blocks[b].channel(c) : scratch.channel(0);
+			ready[b][c] = inStep;
+		}
+
+		deinterleave(samples() + std::min(start, frames) * channels, channels, count, targets.data());
+
+		/* Past the end, the file reads as silence, so that what's downstream
+		 * (delays, filters) can play out */
+		for (int c = 0; c < channels; c++)
+		{
+			std::fill(targets[c] + count, targets[c] + n, T());
+		}
+	}
+
+	/* Grows the buffers to blocks of n frames, keeping what's in them */
+	void reserve(size_t n)
+	{
+		if (n <= blocks[0].capacity())
+		{
+			return;
+		}
+
+		for (auto& block: blocks)
+		{
+			AudioBlock<T> grown(channels, n);
+			grown.setFrames(block.frames());
+			for (int c = 0; c < channels; c++)
+			{
+				std::copy(block.channel(c), block.channel(c) + block.frames(), grown.channel(c));
+			}
+
+			block = std::move(grown);
+		}
+
+		scratch = AudioBlock<T>(1, n);
+	}
+
+	MappedFile file;
+	int channels;
+	size_t frames;
+	std::vector<size_t> positions;
+	std::vector<uint64_t> reads;
+	AudioBlock<T> blocks[2];
+	std::vector<bool> ready[2];
+	AudioBlock<T> scratch;
+	std::vector<T*> targets;
+	std::vector<T> buf;
+};
+
+/* Converts a stream from U to T. A linear conversion (out = in * scale, see
+ * convert.h) runs through the vector kernels, a converter function is called
+ * per sample and is for anything else. */
+template <typename T, typename U>
+class DataStreamConverter: public DataStream<T>
+{
+public:
+	DataStreamConverter(std::shared_ptr<DataStream<U>> dataStream, std::function<T(U)> converter)
+		: dataChannel(dataStream, 0), converter(converter), scale(1)
+	{ }
+
+	DataStreamConverter(const DataChannel<U>& dataChannel, std::function<T(U)> converter)
+		: dataChannel(dataChannel), converter(converter), scale(1)
+	{ }
+
+	DataStreamConverter(const DataChannel<U>& dataChannel, double scale)
+		: dataChannel(dataChannel), scale(scale)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+		buf.resize(data.size());
+
+		if (converter)
+		{
+			std::transform(data.begin(), data.end(), buf.begin(), converter);
+		}
+		else
+		{
+			convertSamples(data.data(), buf.data(), data.size(), scale);
+		}
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+private:
+	std::vector<T> buf;
+	DataChannel<U> dataChannel;
+	std::function<T(U)> converter;
+	double scale;
+};
+
+template <typename T>
+class DcSource: public DataStream<T>
+{
+public:
+	DcSource(T dcValue, size_t n = 1024)
+		: dcValue(dcValue), buffer(n, dcValue)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buffer.resize(frames, dcValue);
+
+		return buffer;
+	}
+
+private:
+	T dcValue;
+	std::vector<T> buffer;
+};
+
+template <typename T>
+class InterleavedVectorSource: public DataStream<T>
+{
+public:
+	InterleavedVectorSource(typename std::vector<T>::iterator it,
+			size_t space, size_t n = 1024)
+	: it(it), buf(n), space(space)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		for(size_t i = 0; i < buf.size(); i++)
+		{
+			buf[i] = *it;
+			it += space;
+		}
+
+		return buf;
+	}
+
+private:
+	typename std::vector<T>::iterator it;
+	std::vector<T> buf;
+	size_t space;
+};
+
+template <typename T>
+class SineSource: public DataStream<T>
+{
+public:
+	SineSource(double rate, T amplitude = 1.0, size_t n = 1024,
+			OscillatorQuality quality = OscillatorQuality::Wavetable)
+		: osc(rate, amplitude, quality), buf(n)
+	{ }
+
+	void setFrequency(double rate) { osc.setFrequency(rate); }
+	void setAmplitude(T amplitude) { osc.setAmplitude(amplitude); }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		osc.render(buf.data(), buf.size());
+
+		return buf;
+	}
+
+private:
+	Oscillator<T> osc;
+	std::vector<T> buf;
+};
+
+template <typename T>
+class OscillatorBankSource: public DataStream<T>
+{
+public:
+	OscillatorBankSource(size_t n = 1024)
+		: buf(n)
+	{ }
+
+	/* Frequencies in cycles per sample, see OscillatorBank::add() */
+	size_t add(double frequency, T amplitude, double vibratoRate = 0, T vibratoDepth = 0)
+	{
+		return bank.add(frequency, amplitude, vibratoRate, vibratoDepth);
+	}
+
+	OscillatorBank<T>& partials() { return bank; }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		bank.render(buf.data(), buf.size());
+
+		return buf;
+	}
+
+private:
+	OscillatorBank<T> bank;
+	std::vector<T> buf;
+};
+
+template <typename T>
+class NoiseSource: public DataStream<T>
+{
+public:
+	/* Pass a seed to get the same noise on every run. Generators with the same
+	 * seed but different streams are independent. */
+	NoiseSource(T amplitude = 1.0, size_t n = 1024, NoiseColor color = NoiseColor::White,
+			uint64_t seed = NoiseGenerator<T>::randomSeed(), uint64_t stream = 0)
+		: noise(seed, stream, color, amplitude), buf(n)
+	{ }
+
+	void setAmplitude(T amplitude) { noise.setAmplitude(amplitude); }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		noise.render(buf.data(), buf.size());
+
+		return buf;
+	}
+
+private:
+	NoiseGenerator<T> noise;
+	std::vector<T> buf;
+};
+
+template <typename T>
+class IncrementSource: public DataStream<T>
+{
+public:
+	IncrementSource(T start = 0, size_t n = 1024)
+		: c(start), buf(n)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		buf.resize(frames);
+		for(size_t i = 0; i < buf.size(); i++)
+		{
+			buf[i] = c++;
+		}
+
+		return buf;
+	}
+
+private:
+	T c;
+	std::vector<T> buf;
+};
+
+/* Hands out channel 0 of a stream on channels channels. Every channel is a
+ * consumer of the stream in its own right, so they can be read in any order
+ * and at their own pace, like any other fan-out. */
+template <typename T>
+class DataDuplicator : public DataStream<T>
+{
+public:
+	DataDuplicator(std::shared_ptr<DataStream<T>> dataStream, int channels)
+		: bufs(channels)
+	{
+		dataChannels.reserve(channels);
+		for (int i = 0; i < channels; i++)
+		{
+			dataChannels.emplace_back(dataStream, 0);
+		}
+	}
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannels[channel].getView(frames);
+		bufs[channel].assign(data.begin(), data.end());
+
+		return bufs[channel];
+	}
+
+	/* Every channel gets the upstream block itself, nothing is copied */
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		return dataChannels[channel].getView(frames);
+	}
+
+	std::vector<Node::Input> inputs() const override
+	{
+		std::vector<Node::Input> res;
+		for (auto& x: dataChannels)
+		{
+			res.push_back(x.input());
+		}
+
+		return res;
+	}
+
+	bool forwardsViews() const override { return true; }
+
+private:
+	std::vector<std::vector<T>> bufs;
+	std::vector<DataChannel<T>> dataChannels;
+};
+
+template <typename T>
+class Deinterleaver : public DataStream<T>
+{
+public:
+	/* Sample start of every inc, so a block takes inc times its frames */
+	Deinterleaver(const DataChannel<T>& dataChannel, size_t start, size_t inc)
+		: dataChannel(dataChannel), start(start), inc(inc)
+	{
+		if (start >= inc)
+		{
+			throw std::invalid_argument("Deinterleaver: start must be below inc");
+		}
+	}
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames * inc);
+
+		buf.resize(frames);
+		for (size_t i = 0; i < buf.size(); i++)
+		{
+			buf[i] = data[start + i * inc];
+		}
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	size_t inputRatio() const override { return inc; }
+
+private:
+	std::vector<T> buf;
+	DataChannel<T> dataChannel;
+	size_t start;
+	size_t inc;
+};
+
+/* Each channel reads every block of the input. The blocks are kept in pool
+ * blocks until every channel has read them, so all channels have to read
+ * blocks of the same size. */
+template <typename T>
+class Splitter : public DataStream<T>
+{
+public:
+	Splitter(const DataChannel<T>& dataChannel, int channels)
+		: dataChannel(dataChannel),
+		  channelPositions(channels), channels(channels)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = getView(channel, frames);
+		buf.assign(data.begin(), data.end());
+
+		return buf;
+	}
+
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		size_t minPos = *std::min_element(channelPositions.begin(), channelPositions.end());
+		if (minPos > 0)
+		{
+			for (int i = 0; i < channels; i++)
+			{
+				channelPositions[i]--;
+			}
+
+			/* Back to the pool */
+			bufs.erase(bufs.begin());
+		}
+
+		size_t channelPos = channelPositions[channel]++;
+
+		if (channelPos >= bufs.size())
+		{
+			auto data = dataChannel.getView(frames);
+
+			Block<T> block(BlockPool<T>::shared());
+			block.assign(data.begin(), data.end());
+			bufs.push_back(std::move(block));
+		}
+
+		return DataView<T>(bufs[channelPos].data(), bufs[channelPos].size());
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	/* Every channel reads the same stream */
+	int outputOf(int channel) const override { return 0; }
+
+protected:
+	size_t blocksNeeded() const override { return 2; }
+
+private:
+	std::vector<Block<T>> bufs;
+	std::vector<T> buf;
+	DataChannel<T> dataChannel;
+	std::vector<size_t> channelPositions;
+	int channels;
+};
+
+/* Splits an interleaved stream into its channels: a block of n frames takes n
+ * frames of every channel from the input. Every channel's blocks are queued
+ * in pool blocks until that channel reads them, so all channels have to read
+ * blocks of the same size. */
+template <typename T>
+class StreamDeinterleaver : public DataStream<T>
+{
+public:
+	StreamDeinterleaver(const DataChannel<T>& dataChannel, int channels)
+		: dataChannel(dataChannel), bufqueues(channels), bufs(channels), planes(channels)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = getView(channel, frames);
+		buf.assign(data.begin(), data.end());
+
+		return buf;
+	}
+
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		auto& queue = bufqueues[channel];
+		size_t channels = bufqueues.size();
+
+		if (queue.empty())
+		{
+			auto data = dataChannel.getView(frames * channels);
+
+			for (size_t i = 0; i < channels; i++)
+			{
+				Block<T> block(BlockPool<T>::shared());
+				block.resize(frames);
+				planes[i] = block.data();
+
+				bufqueues[i].push_back(std::move(block));
+			}
+
+			deinterleave(data.data(), channels, frames, planes.data());
+		}
+
+		/* The previous block goes back to the pool */
+		bufs[channel] = std::move(queue.front());
+		queue.erase(queue.begin());
+
+		return DataView<T>(bufs[channel].data(), bufs[channel].size());
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	size_t inputRatio() const override { return bufs.size(); }
+
+protected:
+	/* A block out and one queued, per channel */
+	size_t blocksNeeded() const override { return 2 * bufs.size(); }
+
+private:
+	DataChannel<T> dataChannel;
+	std::vector<std::vector<Block<T>>> bufqueues;
+	std::vector<Block<T>> bufs;
+	std::vector<T*> planes;
+	std::vector<T> buf;
+};
+
+template <typename T>
+class Chopper : public DataStream<T>
+{
+public:
+	Chopper(const DataChannel<T>& dataChannel,
+			double onTime, double offTime)
+		: dataChannel(dataChannel), t(0), onTime(onTime), period(onTime + offTime)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		buf.clear();
+		for(auto& x: data)
+		{
+			buf.push_back(t <= onTime ? x : 0);
+
+			t++;
+
+			if (t > period)
+			{
+				t -= period;
+			}
+		}
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+private:
+	std::vector<T> buf;
+	DataChannel<T> dataChannel;
+	double t;
+	double onTime;
+	double period;
+};
+
+template <typename T>
+class Transformer : public DataStream<T>
+{
+public:
+	Transformer(const DataChannel<T>& dataChannel)
+		: dataChannel(dataChannel)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		buf.resize(data.size());
+
+		std::transform(data.begin(), data.end(), buf.begin(),
+				std::bind(&Transformer::transform, this, std::placeholders::_1));
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+protected:
+	virtual T transform(T x) = 0;
+
+private:
+	std::vector<T> buf;
+	DataChannel<T> dataChannel;
+};
+
+/* Pointwise operations, for Pointwise nodes */
+template <typename T>
+struct GainOp
+{
+	T gain;
+
+	T operator()(T x) const { return gain * x; }
+};
+
+template <typename T>
+struct OffsetOp
+{
+	T offset;
+
+	T operator()(T x) const { return offset + x; }
+};
+
+template <typename T>
+struct ClipOp
+{
+	T lower;
+	T upper;
+
+	T operator()(T x) const
+	{
+		x = x < lower ? lower : x;
+		x = x > upper ? upper : x;
+		return x;
+	}
+};
+
+/* A chain of pointwise operations applied one after the other, as a single
+ * operation. Everything is known at compile time, so the whole chain inlines
+ * into one expression per sample. */
+template <typename First, typename... Rest>
+struct Fused
+{
+	Fused(First first, Rest... rest)
+		: first(first), rest(rest...)
+	{ }
+
+	template <typename T>
+	T operator()(T x) const { return rest(first(x)); }
+
+	First first;
+	Fused<Rest...> rest;
+};
+
+template <typename Last>
+struct Fused<Last>
+{
+	Fused(Last first)
+		: first(first)
+	{ }
+
+	template <typename T>
+	T operator()(T x) const { return first(x); }
+
+	Last first;
+};
+
+/* Applies Op to every sample in a single pass. Unlike Transformer, there's no
+ * call per sample: the loop is generated for Op and vectorized by the compiler. */
+template <typename T, typename Op>
+class Pointwise : public DataStream<T>
+{
+public:
+	Pointwise(const DataChannel<T>& dataChannel, Op op)
+		: op(op), dataChannel(dataChannel)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		buf.resize(data.size());
+
+		const T* in = data.data();
+		T* out = buf.data();
+		const Op f = op;
+		size_t n = data.size();
+
+		/* Runs of a fixed length, which get vectorized even where loops of
+		 * unknown length aren't (-O2). The copy rules out aliasing. */
+		constexpr size_t run = 8;
+		size_t i = 0;
+
+		for (; i + run <= n; i += run)
+		{
+			T x[run];
+
+#pragma GCC unroll 8
+			for (size_t j = 0; j < run; j++)
+			{
+				x[j] = in[i + j];
+			}
+
+#pragma GCC unroll 8
+			for (size_t j = 0; j < run; j++)
+			{
+				out[i + j] = f(x[j]);
+			}
+		}
+
+		for (; i < n; i++)
+		{
+			out[i] = f(in[i]);
+		}
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	Op& operation() { return op; }
+
+protected:
+	Op op;
+
+private:
+	std::vector<T> buf;
+	DataChannel<T> dataChannel;
+};
+
+/* A Pointwise node running the given operations in order, e.g.
+ * pointwise(channel, ClipOp<T>{-1, 1}, GainOp<T>{.5}) */
+template <typename T, typename... Ops>
+std::shared_ptr<Pointwise<T, Fused<Ops...>>> pointwise(const DataChannel<T>& dataChannel, Ops... ops)
+{
+	return std::make_shared<Pointwise<T, Fused<Ops...>>>(dataChannel, Fused<Ops...>(ops...));
+}
+
+template <typename T>
+class Gain : public Pointwise<T, GainOp<T>>
+{
+public:
+	Gain(const DataChannel<T>& dataChannel, T gain)
+		: Pointwise<T, GainOp<T>>(dataChannel, {gain})
+	{ }
+
+	void setGain(T gain) { this->op.gain = gain; }
+	T getGain() const { return this->op.gain; }
+};
+
+template <typename T>
+class Adder : public Pointwise<T, OffsetOp<T>>
+{
+public:
+	Adder(const DataChannel<T>& dataChannel, T offset)
+		: Pointwise<T, OffsetOp<T>>(dataChannel, {offset})
+	{ }
+
+	void setOffset(T offset) { this->op.offset = offset; }
+	T getOffset() const { return this->op.offset; }
+};
+
+template <typename T>
+class Clip : public Pointwise<T, ClipOp<T>>
+{
+public:
+	Clip(const DataChannel<T>& dataChannel, T lower, T upper)
+		: Pointwise<T, ClipOp<T>>(dataChannel, {lower, upper})
+	{ }
+
+	void setLower(T lower) { this->op.lower = lower; }
+	T getLower() const { return this->op.lower; }
+
+	void setUpper(T upper) { this->op.upper = upper; }
+	T getUpper() const { return this->op.upper; }
+};
+
+
+/* Causal, so the output lags by about half the taps (see latency()): the
+ * group delay of a linear phase filter. */
+template <typename T>
+class FirFilter : public DataStream<T>
+{
+public:
+	/* Filters with more taps than this are convolved in the frequency domain */
+	static constexpr size_t defaultFftThreshold = 384;
+
+	FirFilter(const DataChannel<T>& dataChannel,
+			std::shared_ptr<std::vector<T>> coefficients,
+			size_t fftThreshold = defaultFftThreshold)
+		: dataChannel(dataChannel), coefficients(coefficients),
+		  reversed(coefficients->rbegin(), coefficients->rend()),
+		  window(coefficients->size() - 1)
+	{
+		if (coefficients->size() > fftThreshold)
+		{
+			convolver = std::make_unique<PartitionedConvolver<T>>(*coefficients);
+		}
+	}
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		buf.resize(data.size());
+
+		if (convolver)
+		{
+			convolver->process(data.data(), buf.data(), data.size());
+		}
+		else
+		{
+			directForm(data.data(), buf.data(), data.size());
+		}
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	/* The centre tap */
+	size_t latency() const override { return (reversed.size() - 1) / 2; }
+
+private:
+	void directForm(const T* in, T* out, size_t n)
+	{
+		size_t history = reversed.size() - 1;
+
+		/* Append the block to the last numTaps - 1 input samples, so the taps
+		 * of every output are one contiguous run without any wraparound */
+		window.resize(history);
+		window.insert(window.end(), in, in + n);
+
+		firBlock(reversed.data(), reversed.size(), window.data(), out, n);
+
+		std::copy(window.end() - history, window.end(), window.begin());
+	}
+
+	DataChannel<T> dataChannel;
+	std::shared_ptr<std::vector<T>> coefficients;
+	std::vector<T> buf;
+	std::vector<T> reversed;
+	std::vector<T> window;
+	std::unique_ptr<PartitionedConvolver<T>> convolver;
+};
+
+/* Runs a FIR filter at 1 / factor of the stream's sample rate: the input is
+ * low-passed and decimated, filtered, and interpolated back up. Both rate
+ * changes are polyphase, so only the samples that are kept get computed. Meant
+ * for narrow low-pass work, e.g. coefficients designed for 4800 Hz on a 48 kHz
+ * stream with a factor of 10. Like FirFilter, the output lags by the group
+ * delay, of all three filters here (see latency()). */
+template <typename T>
+class MultirateFirFilter : public DataStream<T>
+{
+public:
+	MultirateFirFilter(const DataChannel<T>& dataChannel,
+			std::shared_ptr<std::vector<T>> coefficients, size_t factor,
+			size_t rateChangeTaps = 0)
+		: dataChannel(dataChannel), factor(factor),
+		  core(coefficients->rbegin(), coefficients->rend()),
+		  phase(factor - 1)
+	{
+		if (rateChangeTaps == 0)
+		{
+			rateChangeTaps = factor * 8 + 1;
+		}
+
+		/* The same low-pass guards against aliasing on the way down
+		 * and removes the images on the way up */
+		auto lowPass = designLowPass<T>(rateChangeTaps, 0.5 / factor);
+
+		decimator.assign(lowPass.rbegin(), lowPass.rend());
+
+		/* Phase p of the interpolator uses every factor'th tap, starting at p.
+		 * The taps make up for the level lost to zero stuffing. */
+		subTaps = (rateChangeTaps + factor - 1) / factor;
+		interpolator.resize(factor * subTaps);
+
+		for (size_t p = 0; p < factor; p++)
+		{
+			for (size_t j = 0; j < subTaps; j++)
+			{
+				size_t k = p + j * factor;
+				interpolator[p * subTaps + subTaps - 1 - j] = k < lowPass.size() ? lowPass[k] * factor : 0;
+			}
+		}
+
+		decimWindow.resize(decimator.size() - 1);
+		coreWindow.resize(core.size() - 1);
+		interpWindow.resize(subTaps - 1);
+
+		/* Group delay of all three stages, in samples at the full rate */
+		delay = (lowPass.size() - 1) + factor * (core.size() - 1) / 2;
+	}
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		/* Decimate. Only every factor'th output of the anti-aliasing filter is computed. */
+		size_t decimHistory = decimator.size() - 1;
+		decimWindow.resize(decimHistory);
+		decimWindow.insert(decimWindow.end(), data.begin(), data.end());
+
+		size_t coreHistory = core.size() - 1;
+		coreWindow.resize(coreHistory);
+
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			if (++phase == factor)
+			{
+				phase = 0;
+				coreWindow.push_back(dotProduct(decimator.data(), &decimWindow[i], decimator.size()));
+			}
+		}
+
+		std::copy(decimWindow.end() - decimHistory, decimWindow.end(), decimWindow.begin());
+
+		/* Filter at the low rate */
+		size_t n = coreWindow.size() - coreHistory;
+		size_t interpHistory = subTaps - 1;
+		interpWindow.resize(interpHistory + n);
+
+		firBlock(core.data(), core.size(), coreWindow.data(), &interpWindow[interpHistory], n);
+
+		std::copy(coreWindow.end() - coreHistory, coreWindow.end(), coreWindow.begin());
+
+		/* Interpolate. Each low-rate sample yields one output sample per phase,
+		 * after what's left from the last block. A low-rate sample is made at
+		 * the first input of every factor, so there's always enough. */
+		size_t left = ahead.size();
+		ahead.resize(left + n * factor);
+
+		for (size_t t = 0; t < n; t++)
+		{
+			for (size_t p = 0; p < factor; p++)
+			{
+				ahead[left + t * factor + p] = dotProduct(&interpolator[p * subTaps], &interpWindow[t], subTaps);
+			}
+		}
+
+		std::copy(interpWindow.end() - interpHistory, interpWindow.end(), interpWindow.begin());
+
+		buf.assign(ahead.begin(), ahead.begin() + frames);
+		ahead.erase(ahead.begin(), ahead.begin() + frames);
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	size_t latency() const override { return delay; }
+
+private:
+	DataChannel<T> dataChannel;
+	size_t factor;
+	std::vector<T> core;
+	std::vector<T> decimator;
+	std::vector<T> interpolator;
+	size_t subTaps;
+	std::vector<T> decimWindow;
+	std::vector<T> coreWindow;
+	std::vector<T> interpWindow;
+	std::vector<T> ahead;	/* Outputs of the last block's final low-rate sample, not asked for yet */
+	std::vector<T> buf;
+	size_t phase;
+	size_t delay;
+};
+
+/* IIR EQ: a cascade of biquads (see biquad.h), a handful of multiplies per
+ * sample and section where a FIR with the same response needs hundreds of
+ * taps. No latency, and blocks come out the size they went in. */
+template <typename T>
+class BiquadFilter : public DataStream<T>
+{
+public:
+	BiquadFilter(const DataChannel<T>& dataChannel, std::vector<BiquadCoefficients<T>> sections = {},
+			size_t rampFrames = BiquadCascade<T>::defaultRampFrames)
+		: dataChannel(dataChannel), cascade(std::move(sections), rampFrames)
+	{ }
+
+	/* Gliding sections to new coefficients, also while the graph runs. Adding
+	 * sections only before it does, see BiquadCascade. */
+	BiquadCascade<T>& sections() { return cascade; }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+
+		buf.resize(data.size());
+		cascade.process(data.data(), buf.data(), data.size());
+
+		return buf;
+	}
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+private:
+	DataChannel<T> dataChannel;
+	BiquadCascade<T> cascade;
+	std::vector<T> buf;
+};
+
+template <typename T, typename U>
+class Combiner : public DataStream<T>
+{
+public:
+	Combiner(std::initializer_list<DataChannel<T>> dataChannels,
+			U combiner = U())
+		: dataChannels(dataChannels), combiner(combiner)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		combine(frames);
+
+		return buf;
+	}
+
+	/* A single input is passed on as is */
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		if (dataChannels.size() == 1)
+		{
+			return dataChannels[0].getView(frames);
+		}
+
+		combine(frames);
+
+		return buf;
+	}
+
+	size_t numStreams() const { return dataChannels.size(); }
+
+	std::vector<Node::Input> inputs() const override
+	{
+		std::vector<Node::Input> res;
+		for (auto& dataChannel: dataChannels)
+		{
+			res.push_back(dataChannel.input());
+		}
+
+		return res;
+	}
+
+	bool forwardsViews() const override { return dataChannels.size() == 1; }
+
+private:
+	void combine(size_t frames)
+	{
+		if (dataChannels.size() == 0)
+		{
+			buf.assign(frames, 0);
+
+			return;
+		}
+
+		auto data0 = dataChannels[0].getView(frames);
+
+		if (dataChannels.size() == 1)
+		{
+			buf.assign(data0.begin(), data0.end());
+
+			return;
+		}
+
+		buf.resize(data0.size());
+
+		/* The first two inputs are combined straight from their views,
+		 * the rest into the result */
+		const T* acc = data0.data();
+
+		for(auto it = dataChannels.begin() + 1; it < dataChannels.end(); it++)
+		{
+			auto data = it->getView(frames);
+
+			std::transform(data.begin(), data.end(), acc,
+					buf.begin(), combiner);
+			acc = buf.data();
+		}
+	}
+
+	std::vector<T> buf;
+	std::vector<DataChannel<T>> dataChannels;
+	U combiner;
+};
+
+template <typename T>
+struct Mixer : public Combiner<T, std::plus<T>>
+{
+	using Combiner<T, std::plus<T>>::Combiner;
+};
+
+template <typename T>
+struct Modulator : public Combiner<T, std::multiplies<T>>
+{
+	using Combiner<T, std::multiplies<T>>::Combiner;
+};
+
+/* One output of a DelayLine: the input delay samples ago, times gain */
+template <typename T>
+struct DelayTap
+{
+	size_t delay;
+	T gain;
+};
+
+/* Multi-tap delay on a power-of-two ring, with the input let through at dry
+ * and the longest tap fed back into the line at feedback:
+ *
+ *   w[n] = x[n] + feedback * w[n - longest]
+ *   y[n] = dry * x[n] + sum of gain * w[n - delay] over the taps
+ *
+ * Blocks come out the size they went in, so echoes and pre-delays need no
+ * re-blocking. A run writes the input into the ring before any tap reads it,
+ * so taps shorter than the run read what it just wrote. Runs are only limited
+ * so that the ring doesn't overwrite what the longest tap still has to read,
+ * and, with feedback, so that what's fed back was written by an earlier run.
+ * What a run reads or writes of the ring is at most two contiguous pieces, one
+ * on either side of its end. */
+template <typename T>
+class DelayLine : public DataStream<T>
+{
+public:
+	DelayLine(const DataChannel<T>& dataChannel, std::vector<DelayTap<T>> taps, T dry = 0, T feedback = 0)
+		: dataChannel(dataChannel), taps(std::move(taps)), dry(dry), feedback(feedback),
+		  longest(0), mask(0), pos(0)
+	{
+		if (this->taps.empty())
+		{
+			throw std::invalid_argument("A delay line needs at least one tap");
+		}
+
+		for (auto& tap: this->taps)
+		{
+			longest = std::max(longest, tap.delay);
+		}
+
+		if (longest == 0 && feedback != 0)
+		{
+			throw std::invalid_argument("Feedback needs a delay");
+		}
+
+		/* Room for the longest delay, plus a run */
+		size_t capacity = 1;
+		while (capacity < longest + 1024)
+		{
+			capacity <<= 1;
+		}
+
+		ring.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	/* Just the input, delay samples late */
+	DelayLine(const DataChannel<T>& dataChannel, size_t delay)
+		: DelayLine(dataChannel, {{delay, 1}})
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		auto data = dataChannel.getView(frames);
+		const T* in = data.data();
+		size_t n = data.size();
+
+		buf.resize(n);
+
+		size_t maxRun = ring.size() - longest;
+		if (feedback != 0)
+		{
+			maxRun = std::min(maxRun, longest);
+		}
+
+		for (size_t done = 0; done < n; )
+		{
+			size_t run = std::min(n - done, maxRun);
+			process(in + done, buf.data() + done, run);
+			done += run;
+		}
+
+		return buf;
+	}
+
+	size_t numTaps() const { return taps.size(); }
+	const DelayTap<T>& tap(size_t i) const { return taps[i]; }
+
+	void setTapGain(size_t i, T gain) { taps[i].gain = gain; }
+	void setDry(T dry) { this->dry = dry; }
+	T getDry() const { return dry; }
+	void setFeedback(T feedback) { this->feedback = longest > 0 ? feedback : 0; }
+	T getFeedback() const { return feedback; }
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+private:
+	/* Calls f(offset, length) over the pieces of [0, n) in which neither the
+	 * ring samples from a nor those from b wrap around the end of the ring */
+	template <typename F>
+	void pieces(size_t a, size_t b, size_t n, F f)
+	{
+		for (size_t i = 0; i < n; )
+		{
+			size_t len = std::min({n - i, ring.size() - ((a + i) & mask), ring.size() - ((b + i) & mask)});
+			f(i, len);
+			i += len;
+		}
+	}
+
+	/* y = a * x + b * z, in runs of 8 like Pointwise, so that it vectorizes.
+	 * y may be x. */
+	static void mix(T* y, T a, const T* x, T b, const T* z, size_t n)
+	{
+		constexpr size_t run = 8;
+		size_t i = 0;
+
+		for (; i + run <= n; i += run)
+		{
+			T u[run], v[run];
+
+#pragma GCC unroll 8
+			for (size_t j = 0; j < run; j++)
+			{
+				u[j] = x[i + j];
+				v[j] = z[i + j];
+			}
+
+#pragma GCC unroll 8
+			for (size_t j = 0; j < run; j++)
+			{
+				y[i + j] = a * u[j] + b * v[j];
+			}
+		}
+
+		for (; i < n; i++)
+		{
+			y[i] = a * x[i] + b * z[i];
+		}
+	}
+
+	/* n is at most ring.size() - longest, and at most longest with feedback */
+	void process(const T* in, T* out, size_t n)
+	{
+		T* w = ring.data();
+		T fb = feedback;
+
+		/* pos is free running, and wraps (as unsigned) together with the mask */
+		pieces(pos, pos - longest, n, [&] (size_t i, size_t len)
+		{
+			T* dst = w + ((pos + i) & mask);
+
+			if (fb == 0)
+			{
+				std::copy(in + i, in + i + len, dst);
+			}
+			else
+			{
+				mix(dst, 1, in + i, fb, w + ((pos - longest + i) & mask), len);
+			}
+		});
+
+		/* The first tap goes in with the dry signal, the others on top */
+		for (size_t k = 0; k < taps.size(); k++)
+		{
+			size_t from = pos - taps[k].delay;
+
+			pieces(from, from, n, [&] (size_t i, size_t len)
+			{
+				const T* src = w + ((from + i) & mask);
+
+				if (k == 0)
+				{
+					mix(out + i, dry, in + i, taps[k].gain, src, len);
+				}
+				else
+				{
+					mix(out + i, 1, out + i, taps[k].gain, src, len);
+				}
+			});
+		}
+
+		pos += n;
+	}
+
+	DataChannel<T> dataChannel;
+	std::vector<DelayTap<T>> taps;
+	T dry;
+	T feedback;
+	size_t longest;
+	std::vector<T> ring;
+	size_t mask;
+	size_t pos;
+	std::vector<T> buf;
+};
+
+/* Pulls its input len frames at a time, whatever its consumers ask for: for
+ * nodes that are better off with blocks of a size of their own. Its input is
+ * pulled on demand, not by Graph::run(). */
+template <typename T>
+class DataBuffer : public DataStream<T>
+{
+public:
+	DataBuffer(const DataChannel<T>& dataChannel, size_t len)
+	: dataChannel(dataChannel), buf(len), ring(len * 4), len(len)
+	{ }
+
+	const std::vector<T>& getData(int channel, size_t frames) override
+	{
+		fill(frames);
+
+		buf.resize(frames);
+		ring.read(buf.data(), frames);
+
+		return buf;
+	}
+
+	DataView<T> getView(int channel, size_t frames) override
+	{
+		/* Already the right size, pass it on as is */
+		if (ring.empty() && frames == len)
+		{
+			return dataChannel.getView(len);
+		}
+
+		fill(frames);
+
+		/* Hand out the ring's memory, unless the block wraps around its end */
+		if (const T* data = ring.peek(frames))
+		{
+			ring.consume(frames);
+
+			return DataView<T>(data, frames);
+		}
+
+		buf.resize(frames);
+		ring.read(buf.data(), frames);
+
+		return buf;
+	}
+
+	inline size_t size() const { return len; }
+
+	std::vector<Node::Input> inputs() const override { return { dataChannel.input() }; }
+
+	bool forwardsViews() const override { return true; }
+
+	size_t inputRatio() const override { return 0; }
+
+private:
+	void fill(size_t frames)
+	{
+		while (ring.size() < frames)
+		{
+			auto data = dataChannel.getView(len);
+			ring.write(data.data(), data.size());
+		}
+	}
+
+	DataChannel<T> dataChannel;
+	std::vector<T> buf;
+	RingBuffer<T> ring;
+	size_t len;
+};
+
+#endif /* NODES_H_ */
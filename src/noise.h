@@ -0,0 +1,385 @@
+/*
+ * noise.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef NOISE_H_
+#define NOISE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <algorithm>
+
+#include "simd.h"
+
+/* xoshiro128+ (Blackman and Vigna) in lanes independent generators side by
+ * side, kept as a structure of arrays so that a run of lanes outputs is
+ * computed in one go with vector instructions. Lane k is the seeded state
+ * jumped ahead k * 2^64 steps, so the lanes never overlap. Streams are
+ * another 2^96 steps apart each, for generators that run in parallel. */
+class Xoshiro128Lanes
+{
+public:
+	static constexpr size_t lanes = 8;
+
+	Xoshiro128Lanes(uint64_t seed, uint64_t stream = 0)
+	{
+		/* splitmix64 spreads any seed, 0 included, over the whole state */
+		uint32_t s[4];
+		for (int i = 0; i < 4; i += 2)
+		{
+			uint64_t z = (seed += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			z ^= z >> 31;
+
+			s[i] = z;
+			s[i + 1] = z >> 32;
+		}
+
+		static const uint32_t longJump[] = { 0xb523952e, 0x0b6f099f, 0xccf5a0ef, 0x1c580662 };
+		for (uint64_t i = 0; i < stream; i++)
+		{
+			jump(s, longJump);
+		}
+
+		static const uint32_t shortJump[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+		for (size_t k = 0; k < lanes; k++)
+		{
+			s0[k] = s[0];
+			s1[k] = s[1];
+			s2[k] = s[2];
+			s3[k] = s[3];
+
+			jump(s, shortJump);
+		}
+	}
+
+	/* Fills runs * lanes samples, uniform in [-gain, gain) or, if triangular,
+	 * the mean of two such: triangular in (-gain, gain). Uses the top 24 bits,
+	 * the low ones of xoshiro128+ are weak. */
+	template <typename T>
+	void fill(T* out, size_t runs, bool triangular, T gain = 1)
+	{
+		if (triangular)
+		{
+			fillScalar<T, true>(out, runs, gain);
+		}
+		else
+		{
+			fillScalar<T, false>(out, runs, gain);
+		}
+	}
+
+	void fill(float* out, size_t runs, bool triangular, float gain = 1)
+	{
+		switch (simdIsa())
+		{
+#if defined(SIMD_X86)
+		case SimdIsa::Avx2: fillAvx2(out, runs, triangular, gain); break;
+		case SimdIsa::Sse: fillSse(out, runs, triangular, gain); break;
+#endif
+		default: fill<float>(out, runs, triangular, gain); break;
+		}
+	}
+
+private:
+	template <typename T, bool triangular>
+	void fillScalar(T* out, size_t runs, T gain)
+	{
+		/* Scaled like the vector kernels do, so that every ISA gives the same samples */
+		const T scale = gain / (1 << 23);
+		const T halfScale = gain * (T) 0.5 / (1 << 23);
+
+		for (size_t i = 0; i < runs; i++, out += lanes)
+		{
+			for (size_t k = 0; k < lanes; k++)
+			{
+				T x = (T) ((int32_t) next(s0[k], s1[k], s2[k], s3[k]) >> 8);
+				if (triangular)
+				{
+					out[k] = (x + (T) ((int32_t) next(s0[k], s1[k], s2[k], s3[k]) >> 8)) * halfScale;
+				}
+				else
+				{
+					out[k] = x * scale;
+				}
+			}
+		}
+	}
+
+#if defined(SIMD_X86)
+	/* One step of four lanes, the top 24 bits of their outputs as floats */
+	__attribute__((target("sse2")))
+	static __m128 nextSse(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+	{
+		__m128i result = _mm_add_epi32(a, d);
+		__m128i t = _mm_slli_epi32(b, 9);
+
+		c = _mm_xor_si128(c, a);
+		d = _mm_xor_si128(d, b);
+		b = _mm_xor_si128(b, c);
+		a = _mm_xor_si128(a, d);
+
+		c = _mm_xor_si128(c, t);
+		d = _mm_or_si128(_mm_slli_epi32(d, 11), _mm_srli_epi32(d, 21));
+
+		return _mm_cvtepi32_ps(_mm_srai_epi32(result, 8));
+	}
+
+	__attribute__((target("avx2")))
+	static __m256 nextAvx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+	{
+		__m256i result = _mm256_add_epi32(a, d);
+		__m256i t = _mm256_slli_epi32(b, 9);
+
+		c = _mm256_xor_si256(c, a);
+		d = _mm256_xor_si256(d, b);
+		b = _mm256_xor_si256(b, c);
+		a = _mm256_xor_si256(a, d);
+
+		c = _mm256_xor_si256(c, t);
+		d = _mm256_or_si256(_mm256_slli_epi32(d, 11), _mm256_srli_epi32(d, 21));
+
+		return _mm256_cvtepi32_ps(_mm256_srai_epi32(result, 8));
+	}
+
+	/* The lanes as two vectors of four */
+	__attribute__((target("sse2")))
+	void fillSse(float* out, size_t runs, bool triangular, float gain)
+	{
+		__m128i a[2], b[2], c[2], d[2];
+		for (int h = 0; h < 2; h++)
+		{
+			a[h] = _mm_loadu_si128((const __m128i*) (s0 + 4 * h));
+			b[h] = _mm_loadu_si128((const __m128i*) (s1 + 4 * h));
+			c[h] = _mm_loadu_si128((const __m128i*) (s2 + 4 * h));
+			d[h] = _mm_loadu_si128((const __m128i*) (s3 + 4 * h));
+		}
+
+		__m128 scale = _mm_set1_ps(gain / (1 << 23));
+		__m128 halfScale = _mm_set1_ps(gain * 0.5f / (1 << 23));
+
+		for (size_t i = 0; i < runs; i++, out += lanes)
+		{
+			for (int h = 0; h < 2; h++)
+			{
+				__m128 x = triangular
+						? _mm_mul_ps(_mm_add_ps(nextSse(a[h], b[h], c[h], d[h]),
+								nextSse(a[h], b[h], c[h], d[h])), halfScale)
+						: _mm_mul_ps(nextSse(a[h], b[h], c[h], d[h]), scale);
+
+				_mm_storeu_ps(out + 4 * h, x);
+			}
+		}
+
+		for (int h = 0; h < 2; h++)
+		{
+			_mm_storeu_si128((__m128i*) (s0 + 4 * h), a[h]);
+			_mm_storeu_si128((__m128i*) (s1 + 4 * h), b[h]);
+			_mm_storeu_si128((__m128i*) (s2 + 4 * h), c[h]);
+			_mm_storeu_si128((__m128i*) (s3 + 4 * h), d[h]);
+		}
+	}
+
+	__attribute__((target("avx2")))
+	void fillAvx2(float* out, size_t runs, bool triangular, float gain)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*) s0);
+		__m256i b = _mm256_loadu_si256((const __m256i*) s1);
+		__m256i c = _mm256_loadu_si256((const __m256i*) s2);
+		__m256i d = _mm256_loadu_si256((const __m256i*) s3);
+
+		__m256 scale = _mm256_set1_ps(gain / (1 << 23));
+		__m256 halfScale = _mm256_set1_ps(gain * 0.5f / (1 << 23));
+
+		for (size_t i = 0; i < runs; i++, out += lanes)
+		{
+			__m256 x = triangular
+					? _mm256_mul_ps(_mm256_add_ps(nextAvx2(a, b, c, d), nextAvx2(a, b, c, d)), halfScale)
+					: _mm256_mul_ps(nextAvx2(a, b, c, d), scale);
+
+			_mm256_storeu_ps(out, x);
+		}
+
+		_mm256_storeu_si256((__m256i*) s0, a);
+		_mm256_storeu_si256((__m256i*) s1, b);
+		_mm256_storeu_si256((__m256i*) s2, c);
+		_mm256_storeu_si256((__m256i*) s3, d);
+	}
+#endif
+
+	static void jump(uint32_t* s, const uint32_t* polynomial)
+	{
+		uint32_t t[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 4; i++)
+		{
+			for (int b = 0; b < 32; b++)
+			{
+				if (polynomial[i] & (1u << b))
+				{
+					for (int j = 0; j < 4; j++)
+					{
+						t[j] ^= s[j];
+					}
+				}
+
+				next(s[0], s[1], s[2], s[3]);
+			}
+		}
+
+		for (int j = 0; j < 4; j++)
+		{
+			s[j] = t[j];
+		}
+	}
+
+	static uint32_t next(uint32_t& s0, uint32_t& s1, uint32_t& s2, uint32_t& s3)
+	{
+		uint32_t result = s0 + s3;
+		uint32_t t = s1 << 9;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+
+		s2 ^= t;
+		s3 = (s3 << 11) | (s3 >> 21);
+
+		return result;
+	}
+
+	uint32_t s0[lanes], s1[lanes], s2[lanes], s3[lanes];
+};
+
+enum class NoiseColor
+{
+	White,	/* Uniform in [-1, 1) */
+	Tpdf,	/* Triangular in (-1, 1), the sum of two uniforms: dither */
+	Pink,	/* -3 dB/octave, Paul Kellett's filter */
+	Brown,	/* -6 dB/octave, leaky integrator */
+};
+
+/* Block noise generator. The same seed and stream give the very same samples,
+ * however the output is cut into blocks. */
+template <typename T>
+class NoiseGenerator
+{
+public:
+	NoiseGenerator(uint64_t seed, uint64_t stream = 0, NoiseColor color = NoiseColor::White, T amplitude = 1)
+		: rng(seed, stream), color(color), amplitude(amplitude), spare(lanes), b()
+	{ }
+
+	/* A seed that differs from run to run */
+	static uint64_t randomSeed()
+	{
+		std::random_device rd;
+		return ((uint64_t) rd() << 32) | rd();
+	}
+
+	void setAmplitude(T amplitude) { this->amplitude = amplitude; }
+
+	void render(T* out, size_t n)
+	{
+		switch (color)
+		{
+		case NoiseColor::White:
+		case NoiseColor::Tpdf: white(out, n, amplitude); break;
+		case NoiseColor::Pink: white(out, n, 1); pink(out, n); break;
+		case NoiseColor::Brown: white(out, n, 1); brown(out, n); break;
+		}
+	}
+
+private:
+	static constexpr size_t lanes = Xoshiro128Lanes::lanes;
+
+	/* Uniform (or triangular) noise. Whole runs go straight to out, the
+	 * remainder of a run is kept for the next block. */
+	void white(T* out, size_t n, T gain)
+	{
+		bool triangular = color == NoiseColor::Tpdf;
+
+		/* The leftover is unscaled, the gain may have changed since */
+		size_t head = std::min(n, lanes - spare);
+		for (size_t i = 0; i < head; i++)
+		{
+			out[i] = leftover[spare + i] * gain;
+		}
+		spare += head;
+		out += head;
+		n -= head;
+
+		size_t runs = n / lanes;
+		rng.fill(out, runs, triangular, gain);
+		out += runs * lanes;
+		n -= runs * lanes;
+
+		if (n > 0)
+		{
+			rng.fill(leftover, 1, triangular, (T) 1);
+			for (size_t i = 0; i < n; i++)
+			{
+				out[i] = leftover[i] * gain;
+			}
+			spare = n;
+		}
+	}
+
+	/* Paul Kellett's refined pink filter, within 0.05 dB of -3 dB/octave
+	 * above 9.2 Hz at 44.1 kHz. Peaks stay roughly within [-1, 1]. The state
+	 * is copied to locals: as members, the stores to out could alias them. */
+	void pink(T* out, size_t n)
+	{
+		const T gain = amplitude * (T) 0.11;
+		T p0 = b[0], p1 = b[1], p2 = b[2], p3 = b[3], p4 = b[4], p5 = b[5], p6 = b[6];
+
+		for (size_t i = 0; i < n; i++)
+		{
+			T w = out[i];
+
+			p0 = (T) 0.99886 * p0 + w * (T) 0.0555179;
+			p1 = (T) 0.99332 * p1 + w * (T) 0.0750759;
+			p2 = (T) 0.96900 * p2 + w * (T) 0.1538520;
+			p3 = (T) 0.86650 * p3 + w * (T) 0.3104856;
+			p4 = (T) 0.55000 * p4 + w * (T) 0.5329522;
+			p5 = (T) -0.7616 * p5 - w * (T) 0.0168980;
+
+			out[i] = (p0 + p1 + p2 + p3 + p4 + p5 + p6 + w * (T) 0.5362) * gain;
+
+			p6 = w * (T) 0.115926;
+		}
+
+		b[0] = p0; b[1] = p1; b[2] = p2; b[3] = p3; b[4] = p4; b[5] = p5; b[6] = p6;
+	}
+
+	/* Integrated white noise, leaking just enough to stay bounded */
+	void brown(T* out, size_t n)
+	{
+		const T gain = amplitude * (T) 3.5;
+		T y = b[0];
+
+		for (size_t i = 0; i < n; i++)
+		{
+			y = (y + (T) 0.02 * out[i]) * (T) (1 / 1.02);
+			out[i] = y * gain;
+		}
+
+		b[0] = y;
+	}
+
+	Xoshiro128Lanes rng;
+	NoiseColor color;
+	T amplitude;
+
+	T leftover[lanes];
+	size_t spare;
+
+	/* Filter state */
+	T b[7];
+};
+
+#endif /* NOISE_H_ */
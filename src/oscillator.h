@@ -0,0 +1,303 @@
+/*
+ * oscillator.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef OSCILLATOR_H_
+#define OSCILLATOR_H_
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+enum class OscillatorQuality
+{
+	Wavetable,	/* Linearly interpolated 4096 entry table, ~4e-7 error */
+	Quadrature,	/* Rotating phasors, resynced from the phase every block, ~3e-6 error */
+	Polynomial,	/* 11th order odd polynomial, ~2e-7 error */
+};
+
+/* Sets out[i] = f(i), or adds f(i) to it, for every i in [0, n). Works in
+ * runs of a fixed length, computed into a local array first, which get
+ * vectorized even where loops of unknown length aren't (-O2). The lane
+ * offsets come from an array, so that lane 0 doesn't get its "+ 0" folded
+ * away: the vectorizer wants every lane to do the very same thing. */
+template <size_t lanes, bool accumulate = false, typename T, typename F>
+inline void renderRuns(T* out, size_t n, F f)
+{
+	uint32_t offset[lanes];
+	for (size_t k = 0; k < lanes; k++)
+	{
+		offset[k] = k;
+	}
+
+	size_t i = 0;
+	for (; i + lanes <= n; i += lanes)
+	{
+		T x[lanes];
+
+#pragma GCC unroll 8
+		for (size_t k = 0; k < lanes; k++)
+		{
+			x[k] = f((uint32_t) i + offset[k]);
+		}
+
+#pragma GCC unroll 8
+		for (size_t k = 0; k < lanes; k++)
+		{
+			out[i + k] = accumulate ? out[i + k] + x[k] : x[k];
+		}
+	}
+
+	for (size_t k = 0; k < std::min(n - i, lanes); k++)
+	{
+		out[i + k] = accumulate ? out[i + k] + f((uint32_t) (i + k)) : f((uint32_t) (i + k));
+	}
+}
+
+/* sin() of a 32 bit phase (2^32 is a full cycle), to ~2e-7 */
+template <typename T>
+inline T polySine(uint32_t phase)
+{
+	/* Taylor series of sin(pi / 2 * x), good to ~6e-8 on [-1, 1] */
+	const T c1 = 1.5707963267948966, c3 = -0.6459640975062462,
+			c5 = 0.07969262624616704, c7 = -0.004681754135318687,
+			c9 = 0.00016044118478735982, c11 = -3.598843235212085e-06;
+	const T scale = (T) 1 / (1 << 30);
+
+	/* Fold the phase into [-2^30, 2^30], i.e. [-pi / 2, pi / 2], where the
+	 * series holds: a triangle wave, 2^30 - |phase - 2^30|, taken in
+	 * unsigned arithmetic. No selects, so it vectorizes at -O2. */
+	uint32_t w = phase - (1u << 30);
+	uint32_t sign = (uint32_t) ((int32_t) w >> 31);
+	uint32_t magnitude = (w ^ sign) - sign;
+	int32_t q = (int32_t) ((1u << 30) - magnitude);
+
+	T x = (T) q * scale;
+	T x2 = x * x;
+
+	return x * (c1 + x2 * (c3 + x2 * (c5 + x2 * (c7 + x2 * (c9 + x2 * c11)))));
+}
+
+/* Cycles (per sample) to phase steps, modulo one cycle */
+inline uint32_t phaseSteps(double cycles)
+{
+	return (uint32_t) (int64_t) std::llround((cycles - std::floor(cycles)) * 4294967296.0);
+}
+
+/* Sine oscillator driven by a 32 bit phase accumulator.
+ *
+ * A full cycle is 2^32 phase steps, so the phase wraps by itself, the
+ * frequency is exact to 1 / 2^32 cycles per sample (about 11 uHz at 48 kHz)
+ * and the phase never drifts, however long it runs: the sample at time t is
+ * always computed from the exact phase t * increment. Blocks are rendered
+ * in runs of independent lanes, which the compiler vectorizes. */
+template <typename T>
+class Oscillator
+{
+public:
+	/* frequency is in cycles per sample, phase in cycles */
+	Oscillator(double frequency, T amplitude = 1,
+			OscillatorQuality quality = OscillatorQuality::Wavetable, double phase = 0)
+		: amplitude(amplitude), quality(quality),
+		  phase(phaseSteps(phase))
+	{
+		setFrequency(frequency);
+	}
+
+	void setFrequency(double frequency)
+	{
+		increment = phaseSteps(frequency);
+	}
+
+	void setAmplitude(T amplitude) { this->amplitude = amplitude; }
+
+	void render(T* out, size_t n)
+	{
+		switch (quality)
+		{
+		case OscillatorQuality::Wavetable: renderWavetable(out, n); break;
+		case OscillatorQuality::Quadrature: renderQuadrature(out, n); break;
+		case OscillatorQuality::Polynomial: renderPolynomial(out, n); break;
+		}
+
+		phase += (uint32_t) n * increment;
+	}
+
+private:
+	static constexpr int tableBits = 12;
+	static constexpr size_t lanes = 8;
+
+	/* One cycle, with the first entry repeated at the end for the interpolation */
+	static const std::vector<T>& sineTable()
+	{
+		static const std::vector<T> table = [] ()
+		{
+			std::vector<T> t((1 << tableBits) + 1);
+			for (size_t i = 0; i < t.size(); i++)
+			{
+				t[i] = std::sin(2 * M_PI * i / (1 << tableBits));
+			}
+
+			return t;
+		}();
+
+		return table;
+	}
+
+	void renderWavetable(T* out, size_t n)
+	{
+		const T* table = sineTable().data();
+		const int fracBits = 32 - tableBits;
+		const T fracScale = (T) 1 / (1 << fracBits);
+
+		renderRuns<lanes>(out, n, [=] (uint32_t i)
+		{
+			uint32_t p = phase + i * increment;
+			uint32_t index = p >> fracBits;
+			T frac = (T) (p & ((1u << fracBits) - 1)) * fracScale;
+
+			T a = table[index];
+			T b = table[index + 1];
+
+			return (a + (b - a) * frac) * amplitude;
+		});
+	}
+
+	/* Each lane rotates a phasor by lanes samples' worth per step, so the
+	 * lanes are independent. The phasors are computed from the exact phase at
+	 * the start of every block, which renormalizes them; within a block the
+	 * rounding error of a few hundred rotations stays far below float noise. */
+	void renderQuadrature(T* out, size_t n)
+	{
+		T re[lanes], im[lanes];
+		for (size_t k = 0; k < lanes; k++)
+		{
+			double a = angle(phase + (uint32_t) k * increment);
+			re[k] = std::cos(a);
+			im[k] = std::sin(a);
+		}
+
+		double step = angle((uint32_t) lanes * increment);
+		const T c = std::cos(step);
+		const T s = std::sin(step);
+
+		size_t i = 0;
+		for (; i + lanes <= n; i += lanes)
+		{
+			for (size_t k = 0; k < lanes; k++)
+			{
+				out[i + k] = im[k] * amplitude;
+
+				T r = re[k] * c - im[k] * s;
+				im[k] = re[k] * s + im[k] * c;
+				re[k] = r;
+			}
+		}
+
+		for (size_t k = 0; k < std::min(n - i, lanes); k++)
+		{
+			out[i + k] = im[k] * amplitude;
+		}
+	}
+
+	void renderPolynomial(T* out, size_t n)
+	{
+		renderRuns<lanes>(out, n, [=] (uint32_t i)
+		{
+			return polySine<T>(phase + i * increment) * amplitude;
+		});
+	}
+
+	static double angle(uint32_t p) { return 2 * M_PI * p / 4294967296.0; }
+
+	T amplitude;
+	OscillatorQuality quality;
+	uint32_t phase;
+	uint32_t increment;
+};
+
+/* A bank of sine partials, each with its own amplitude and a sine vibrato
+ * that modulates its amplitude by (1 + depth * sin). The partials are kept as
+ * a structure of arrays and rendered one after the other into the same block,
+ * each in a single vectorized loop; the block stays in L1 all along. */
+template <typename T>
+class OscillatorBank
+{
+public:
+	/* frequency and vibratoRate are in cycles per sample. Returns the partial's index. */
+	size_t add(double frequency, T amplitude, double vibratoRate = 0, T vibratoDepth = 0)
+	{
+		phases.push_back(0);
+		increments.push_back(phaseSteps(frequency));
+		amplitudes.push_back(amplitude);
+		vibratoPhases.push_back(0);
+		vibratoIncrements.push_back(phaseSteps(vibratoRate));
+		vibratoDepths.push_back(vibratoDepth);
+
+		return phases.size() - 1;
+	}
+
+	void setFrequency(size_t partial, double frequency) { increments[partial] = phaseSteps(frequency); }
+	void setAmplitude(size_t partial, T amplitude) { amplitudes[partial] = amplitude; }
+
+	void setVibrato(size_t partial, double rate, T depth)
+	{
+		vibratoIncrements[partial] = phaseSteps(rate);
+		vibratoDepths[partial] = depth;
+	}
+
+	size_t size() const { return phases.size(); }
+
+	void render(T* out, size_t n)
+	{
+		std::fill(out, out + n, 0);
+
+		for (size_t p = 0; p < phases.size(); p++)
+		{
+			const uint32_t phase = phases[p];
+			const uint32_t increment = increments[p];
+			const T amplitude = amplitudes[p];
+			const uint32_t vibratoPhase = vibratoPhases[p];
+			const uint32_t vibratoIncrement = vibratoIncrements[p];
+			const T depth = vibratoDepths[p];
+
+			if (depth == 0)
+			{
+				renderRuns<lanes, true>(out, n, [=] (uint32_t i)
+				{
+					return polySine<T>(phase + i * increment) * amplitude;
+				});
+			}
+			else
+			{
+				renderRuns<lanes, true>(out, n, [=] (uint32_t i)
+				{
+					T tone = polySine<T>(phase + i * increment);
+					T vibrato = polySine<T>(vibratoPhase + i * vibratoIncrement);
+
+					return tone * amplitude * (1 + vibrato * depth);
+				});
+			}
+
+			phases[p] += (uint32_t) n * increment;
+			vibratoPhases[p] += (uint32_t) n * vibratoIncrement;
+		}
+	}
+
+private:
+	static constexpr size_t lanes = 8;
+
+	std::vector<uint32_t> phases;
+	std::vector<uint32_t> increments;
+	std::vector<T> amplitudes;
+	std::vector<uint32_t> vibratoPhases;
+	std::vector<uint32_t> vibratoIncrements;
+	std::vector<T> vibratoDepths;
+};
+
+#endif /* OSCILLATOR_H_ */
@@ -0,0 +1,189 @@
+/*
+ * output.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+#include "audioblock.h"
+
+/* Where a sink's frames end up: a sound card, a file, nowhere. Frames are
+ * handed over one plane per channel. */
+template <typename T>
+class Output
+{
+public:
+	virtual ~Output() { }
+
+	/* Writes frames frames of every channel. Returns false once the output
+	 * failed for good. */
+	virtual bool write(const T* const* planes, size_t frames) = 0;
+
+	virtual int numChannels() const = 0;
+	virtual int sampleRate() const = 0;
+
+	/* The frames it takes at a time, like a device's period. 0 if any number
+	 * will do. */
+	virtual size_t period() const { return 0; }
+};
+
+/* Discards everything: for benchmarking the graph on its own */
+template <typename T>
+class NullOutput : public Output<T>
+{
+public:
+	NullOutput(int channels, int rate)
+		: channels(channels), rate(rate)
+	{ }
+
+	bool write(const T* const* planes, size_t frames) override { return true; }
+
+	int numChannels() const override { return channels; }
+	int sampleRate() const override { return rate; }
+
+private:
+	int channels;
+	int rate;
+};
+
+/* Headerless interleaved samples, as they are in memory */
+template <typename T>
+class RawFileOutput : public Output<T>
+{
+public:
+	RawFileOutput(const std::string& filename, int channels, int rate)
+		: file(filename, std::ios::binary | std::ios::trunc), channels(channels), rate(rate)
+	{
+		if (!file)
+		{
+			throw std::system_error(errno, std::generic_category(), filename);
+		}
+	}
+
+	bool write(const T* const* planes, size_t frames) override
+	{
+		buf.resize(frames * channels);
+		interleave(planes, channels, frames, buf.data());
+
+		file.write((const char*) buf.data(), buf.size() * sizeof(T));
+
+		return (bool) file;
+	}
+
+	int numChannels() const override { return channels; }
+	int sampleRate() const override { return rate; }
+
+protected:
+	std::ofstream file;
+	int channels;
+	int rate;
+
+private:
+	std::vector<T> buf;
+};
+
+/* RIFF/WAVE: integer PCM for integer samples, IEEE float for float and double.
+ * The sizes in the header are filled in when the file is closed. */
+template <typename T>
+class WavFileOutput : public RawFileOutput<T>
+{
+public:
+	WavFileOutput(const std::string& filename, int channels, int rate)
+		: RawFileOutput<T>(filename, channels, rate), dataBytes(0)
+	{
+		writeHeader();
+	}
+
+	~WavFileOutput()
+	{
+		/* Patch the sizes in, now that they're known */
+		this->file.seekp(0);
+		writeHeader();
+	}
+
+	bool write(const T* const* planes, size_t frames) override
+	{
+		dataBytes += frames * this->channels * sizeof(T);
+
+		return RawFileOutput<T>::write(planes, frames);
+	}
+
+private:
+	void writeHeader()
+	{
+		const uint16_t format = std::is_floating_point<T>::value ? 3 : 1;
+		const uint16_t channels = this->channels;
+		const uint32_t rate = this->rate;
+		const uint16_t blockAlign = channels * sizeof(T);
+		const uint32_t byteRate = rate * blockAlign;
+		const uint16_t bits = sizeof(T) * 8;
+
+		/* The sizes are 32 bit: a file past 4 GiB is still written, but its
+		 * header saturates */
+		uint32_t data = dataBytes > 0xffffffff - 36 ? 0xffffffff - 36 : dataBytes;
+
+		auto& f = this->file;
+		f.write("RIFF", 4);
+		put<uint32_t>(36 + data);
+		f.write("WAVE", 4);
+
+		f.write("fmt ", 4);
+		put<uint32_t>(16);
+		put<uint16_t>(format);
+		put<uint16_t>(channels);
+		put<uint32_t>(rate);
+		put<uint32_t>(byteRate);
+		put<uint16_t>(blockAlign);
+		put<uint16_t>(bits);
+
+		f.write("data", 4);
+		put<uint32_t>(data);
+	}
+
+	/* Little endian, whatever the host */
+	template <typename U>
+	void put(U value)
+	{
+		char bytes[sizeof(U)];
+		for (size_t i = 0; i < sizeof(U); i++)
+		{
+			bytes[i] = (char) (value >> (8 * i));
+		}
+
+		this->file.write(bytes, sizeof(U));
+	}
+
+	uint64_t dataBytes;
+};
+
+/* "null", a .wav file, or else a raw file */
+template <typename T>
+inline std::unique_ptr<Output<T>> openOutput(const std::string& name, int channels, int rate)
+{
+	if (name == "null")
+	{
+		return std::make_unique<NullOutput<T>>(channels, rate);
+	}
+
+	if (name.size() >= 4 && name.compare(name.size() - 4, 4, ".wav") == 0)
+	{
+		return std::make_unique<WavFileOutput<T>>(name, channels, rate);
+	}
+
+	return std::make_unique<RawFileOutput<T>>(name, channels, rate);
+}
+
+#endif /* OUTPUT_H_ */
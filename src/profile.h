@@ -0,0 +1,190 @@
+/*
+ * profile.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <cxxabi.h>
+#include <unistd.h>
+
+/* Whether nodes time their blocks. Off by default: then all it costs is
+ * reading this flag once per block. */
+inline std::atomic<bool>& profiling()
+{
+	static std::atomic<bool> enabled(false);
+
+	return enabled;
+}
+
+/* Heap allocations made on this thread so far, and on all threads. Counted by
+ * whoever replaces operator new (BrownNote.cpp does, see countAllocation()),
+ * zero otherwise. */
+inline uint64_t& threadAllocations()
+{
+	static thread_local uint64_t n = 0;
+
+	return n;
+}
+
+inline std::atomic<uint64_t>& totalAllocations()
+{
+	static std::atomic<uint64_t> n(0);
+
+	return n;
+}
+
+/* Whether allocating on the audio path aborts the program. Off by default;
+ * turn it on once the graph has warmed up. */
+inline std::atomic<bool>& checkAllocations()
+{
+	static std::atomic<bool> enabled(false);
+
+	return enabled;
+}
+
+/* How many AllocationFreeScopes this thread is in */
+inline int& allocationFreeDepth()
+{
+	static thread_local int depth = 0;
+
+	return depth;
+}
+
+/* Marks code that runs every cycle, and so must not allocate (Graph::run(),
+ * sinks). With checkAllocations() on, allocating in there aborts. */
+class AllocationFreeScope
+{
+public:
+	AllocationFreeScope() { allocationFreeDepth()++; }
+	~AllocationFreeScope() { allocationFreeDepth()--; }
+};
+
+/* For operator new: must not allocate, or print through iostreams */
+inline void countAllocation()
+{
+	threadAllocations()++;
+	totalAllocations().fetch_add(1, std::memory_order_relaxed);
+
+	if (allocationFreeDepth() > 0 && checkAllocations().load(std::memory_order_relaxed))
+	{
+		static const char message[] = "Heap allocation on the audio path\n";
+		if (write(2, message, sizeof(message) - 1) < 0)
+		{ }
+
+		abort();
+	}
+}
+
+/* What a node cost so far. Times and allocations are the node's own: what
+ * the nodes it pulled from took is theirs. A node only computes one block at
+ * a time, so there's a single writer; the report reads them from elsewhere. */
+struct NodeProfile
+{
+	std::atomic<uint64_t> calls{0};
+	std::atomic<uint64_t> samples{0};
+	std::atomic<uint64_t> nanoseconds{0};
+	std::atomic<uint64_t> maxNanoseconds{0};
+	std::atomic<uint64_t> allocations{0};
+
+	void add(size_t n, uint64_t ns, uint64_t allocs)
+	{
+		auto add = [] (std::atomic<uint64_t>& x, uint64_t v) { x.store(x.load(std::memory_order_relaxed) + v, std::memory_order_relaxed); };
+
+		add(calls, 1);
+		add(samples, n);
+		add(nanoseconds, ns);
+		add(allocations, allocs);
+
+		if (ns > maxNanoseconds.load(std::memory_order_relaxed))
+		{
+			maxNanoseconds.store(ns, std::memory_order_relaxed);
+		}
+	}
+
+	void reset()
+	{
+		for (auto x: {&calls, &samples, &nanoseconds, &maxNanoseconds, &allocations})
+		{
+			x->store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+/* Times one block of a node. Scopes nest along the pulls on a thread: an
+ * inner scope's time and allocations are taken off the one around it. */
+class ProfileScope
+{
+public:
+	ProfileScope(NodeProfile& profile)
+		: profile(profile), parent(current()),
+		  start(Clock::now()), allocations(threadAllocations()),
+		  childNanoseconds(0), childAllocations(0)
+	{
+		current() = this;
+	}
+
+	~ProfileScope()
+	{
+		current() = parent;
+	}
+
+	/* Call with the size of the block, once it's computed */
+	void done(size_t samples)
+	{
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		uint64_t allocs = threadAllocations() - allocations;
+
+		profile.add(samples, ns - std::min(ns, childNanoseconds), allocs - std::min(allocs, childAllocations));
+
+		if (parent)
+		{
+			parent->childNanoseconds += ns;
+			parent->childAllocations += allocs;
+		}
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	static ProfileScope*& current()
+	{
+		static thread_local ProfileScope* scope = nullptr;
+
+		return scope;
+	}
+
+	NodeProfile& profile;
+	ProfileScope* parent;
+	Clock::time_point start;
+	uint64_t allocations;
+	uint64_t childNanoseconds;
+	uint64_t childAllocations;
+};
+
+/* "DelayLine<float>" rather than "9DelayLineIfE" */
+inline std::string demangle(const char* name)
+{
+	int status;
+	char* s = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if (status != 0)
+	{
+		return name;
+	}
+
+	std::string res(s);
+	free(s);
+
+	return res;
+}
+
+#endif /* PROFILE_H_ */
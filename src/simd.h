@@ -0,0 +1,417 @@
+/*
+ * simd.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+enum class SimdIsa
+{
+	Scalar,
+	Sse,
+	Avx2,
+	Neon,
+};
+
+/* The instruction set the kernels dispatch to. Detected on first use, but it
+ * can be overridden (e.g. to compare kernels against each other). */
+inline SimdIsa& simdIsa()
+{
+	static SimdIsa isa = [] ()
+	{
+#if defined(SIMD_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		{
+			return SimdIsa::Avx2;
+		}
+		if (__builtin_cpu_supports("sse2"))
+		{
+			return SimdIsa::Sse;
+		}
+#elif defined(SIMD_NEON)
+		/* NEON is part of the baseline on every target that defines __ARM_NEON */
+		return SimdIsa::Neon;
+#endif
+		return SimdIsa::Scalar;
+	}();
+
+	return isa;
+}
+
+inline const char* simdIsaName(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case SimdIsa::Sse: return "sse";
+	case SimdIsa::Avx2: return "avx2";
+	case SimdIsa::Neon: return "neon";
+	default: return "scalar";
+	}
+}
+
+template <typename T>
+inline T dotProductScalar(const T* a, const T* b, size_t n)
+{
+	/* Independent accumulators, so the adds don't form one long dependency chain */
+	T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 += a[i + 0] * b[i + 0];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	for (; i < n; i++)
+	{
+		s0 += a[i] * b[i];
+	}
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+#if defined(SIMD_X86)
+__attribute__((target("sse2")))
+inline float dotProductSse(const float* a, const float* b, size_t n)
+{
+	__m128 s0 = _mm_setzero_ps();
+	__m128 s1 = _mm_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+
+	s0 = _mm_add_ps(s0, s1);
+	s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+	s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+
+	float sum = _mm_cvtss_f32(s0);
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+__attribute__((target("sse2")))
+inline double dotProductSse(const double* a, const double* b, size_t n)
+{
+	__m128d s0 = _mm_setzero_pd();
+	__m128d s1 = _mm_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+
+	s0 = _mm_add_pd(s0, s1);
+	double sum = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+inline float dotProductAvx2(const float* a, const float* b, size_t n)
+{
+	__m256 s0 = _mm256_setzero_ps();
+	__m256 s1 = _mm256_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+	}
+	for (; i + 8 <= n; i += 8)
+	{
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+	}
+
+	s0 = _mm256_add_ps(s0, s1);
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+
+	float sum = _mm_cvtss_f32(s);
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+inline double dotProductAvx2(const double* a, const double* b, size_t n)
+{
+	__m256d s0 = _mm256_setzero_pd();
+	__m256d s1 = _mm256_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+	}
+
+	s0 = _mm256_add_pd(s0, s1);
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+	double sum = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+/* out[i] = sum(c[k] * in[i + k]) for k in [0, numTaps). Eight (or sixteen)
+ * outputs are accumulated side by side, so each coefficient is broadcast
+ * once per group and no horizontal sums are needed. */
+__attribute__((target("sse2")))
+inline void firBlockSse(const float* c, size_t numTaps, const float* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128 s0 = _mm_setzero_ps();
+		__m128 s1 = _mm_setzero_ps();
+
+		for (size_t k = 0; k < numTaps; k++)
+		{
+			__m128 ck = _mm_set1_ps(c[k]);
+			s0 = _mm_add_ps(s0, _mm_mul_ps(ck, _mm_loadu_ps(in + i + k)));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(ck, _mm_loadu_ps(in + i + k + 4)));
+		}
+
+		_mm_storeu_ps(out + i, s0);
+		_mm_storeu_ps(out + i + 4, s1);
+	}
+	for (; i < n; i++)
+	{
+		out[i] = dotProductSse(c, in + i, numTaps);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+inline void firBlockAvx2(const float* c, size_t numTaps, const float* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m256 s0 = _mm256_setzero_ps();
+		__m256 s1 = _mm256_setzero_ps();
+
+		for (size_t k = 0; k < numTaps; k++)
+		{
+			__m256 ck = _mm256_broadcast_ss(c + k);
+			s0 = _mm256_fmadd_ps(ck, _mm256_loadu_ps(in + i + k), s0);
+			s1 = _mm256_fmadd_ps(ck, _mm256_loadu_ps(in + i + k + 8), s1);
+		}
+
+		_mm256_storeu_ps(out + i, s0);
+		_mm256_storeu_ps(out + i + 8, s1);
+	}
+	for (; i < n; i++)
+	{
+		out[i] = dotProductAvx2(c, in + i, numTaps);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+inline void firBlockAvx2(const double* c, size_t numTaps, const double* in, double* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256d s0 = _mm256_setzero_pd();
+		__m256d s1 = _mm256_setzero_pd();
+
+		for (size_t k = 0; k < numTaps; k++)
+		{
+			__m256d ck = _mm256_broadcast_sd(c + k);
+			s0 = _mm256_fmadd_pd(ck, _mm256_loadu_pd(in + i + k), s0);
+			s1 = _mm256_fmadd_pd(ck, _mm256_loadu_pd(in + i + k + 4), s1);
+		}
+
+		_mm256_storeu_pd(out + i, s0);
+		_mm256_storeu_pd(out + i + 4, s1);
+	}
+	for (; i < n; i++)
+	{
+		out[i] = dotProductAvx2(c, in + i, numTaps);
+	}
+}
+#endif
+
+#if defined(SIMD_NEON)
+inline float dotProductNeon(const float* a, const float* b, size_t n)
+{
+	float32x4_t s0 = vdupq_n_f32(0);
+	float32x4_t s1 = vdupq_n_f32(0);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+		s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+	}
+
+	s0 = vaddq_f32(s0, s1);
+	float32x2_t s = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+
+	float sum = vget_lane_f32(vpadd_f32(s, s), 0);
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+inline void firBlockNeon(const float* c, size_t numTaps, const float* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		float32x4_t s0 = vdupq_n_f32(0);
+		float32x4_t s1 = vdupq_n_f32(0);
+
+		for (size_t k = 0; k < numTaps; k++)
+		{
+			float32x4_t ck = vdupq_n_f32(c[k]);
+			s0 = vmlaq_f32(s0, ck, vld1q_f32(in + i + k));
+			s1 = vmlaq_f32(s1, ck, vld1q_f32(in + i + k + 4));
+		}
+
+		vst1q_f32(out + i, s0);
+		vst1q_f32(out + i + 4, s1);
+	}
+	for (; i < n; i++)
+	{
+		out[i] = dotProductNeon(c, in + i, numTaps);
+	}
+}
+#endif
+
+/* sum(a[i] * b[i]) for i in [0, n) */
+template <typename T>
+inline T dotProduct(const T* a, const T* b, size_t n)
+{
+	return dotProductScalar(a, b, n);
+}
+
+template <>
+inline float dotProduct(const float* a, const float* b, size_t n)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: return dotProductAvx2(a, b, n);
+	case SimdIsa::Sse: return dotProductSse(a, b, n);
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: return dotProductNeon(a, b, n);
+#endif
+	default: return dotProductScalar(a, b, n);
+	}
+}
+
+template <>
+inline double dotProduct(const double* a, const double* b, size_t n)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: return dotProductAvx2(a, b, n);
+	case SimdIsa::Sse: return dotProductSse(a, b, n);
+#endif
+	default: return dotProductScalar(a, b, n);
+	}
+}
+
+template <typename T>
+inline void firBlockScalar(const T* c, size_t numTaps, const T* in, T* out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		out[i] = dotProductScalar(c, in + i, numTaps);
+	}
+}
+
+/* Direct-form FIR over a block: out[i] = sum(c[k] * in[i + k]) for k in
+ * [0, numTaps), i in [0, n). in must hold n + numTaps - 1 samples, so with the
+ * coefficients stored in reverse, in[i + numTaps - 1] is the newest sample of
+ * output i. */
+template <typename T>
+inline void firBlock(const T* c, size_t numTaps, const T* in, T* out, size_t n)
+{
+	firBlockScalar(c, numTaps, in, out, n);
+}
+
+template <>
+inline void firBlock(const float* c, size_t numTaps, const float* in, float* out, size_t n)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: firBlockAvx2(c, numTaps, in, out, n); break;
+	case SimdIsa::Sse: firBlockSse(c, numTaps, in, out, n); break;
+#elif defined(SIMD_NEON)
+	case SimdIsa::Neon: firBlockNeon(c, numTaps, in, out, n); break;
+#endif
+	default: firBlockScalar(c, numTaps, in, out, n); break;
+	}
+}
+
+template <>
+inline void firBlock(const double* c, size_t numTaps, const double* in, double* out, size_t n)
+{
+	switch (simdIsa())
+	{
+#if defined(SIMD_X86)
+	case SimdIsa::Avx2: firBlockAvx2(c, numTaps, in, out, n); break;
+	case SimdIsa::Sse:
+		for (size_t i = 0; i < n; i++)
+		{
+			out[i] = dotProductSse(c, in + i, numTaps);
+		}
+		break;
+#endif
+	default: firBlockScalar(c, numTaps, in, out, n); break;
+	}
+}
+
+#endif /* SIMD_H_ */
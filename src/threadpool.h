@@ -0,0 +1,329 @@
+/*
+ * threadpool.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tom
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+/* Work-stealing thread pool for fork/join work.
+ *
+ * Every worker has its own deque. It pushes and pops its own tasks at the back
+ * (newest first, which keeps the working set warm) and steals from the front of
+ * the others when it runs dry. Threads outside the pool submit to a shared
+ * queue that the workers steal from as well.
+ *
+ * A thread waiting for a TaskGroup only helps with tasks of that group. The
+ * tasks run graph pulls that take node locks, and picking up an unrelated task
+ * could make a thread wait on a lock it already holds itself.
+ *
+ * A task that throws doesn't take its worker down: the exception is kept with
+ * its group, and wait() rethrows it once every task of the group is done.
+ *
+ * A waiting thread that finds nothing of its group to run sleeps until the
+ * last task finishes or another one is queued, rather than spinning while
+ * workers run the rest. */
+class ThreadPool
+{
+public:
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : pending(0), posted(0) { }
+
+	private:
+		friend class ThreadPool;
+
+		/* Keeps the first exception any of the tasks threw */
+		void fail(std::exception_ptr e)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = e;
+			}
+		}
+
+		/* Wakes the waiting thread. Under the mutex, so that it can't miss it
+		 * between checking and going to sleep. */
+		void notify()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+
+		/* Under the mutex as well: the waiting thread takes it once more
+		 * before it returns, so the group outlives the last task's notify */
+		void finish()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				done.notify_all();
+			}
+		}
+
+		std::atomic<size_t> pending;
+		std::atomic<uint64_t> posted;	/* Tasks queued so far */
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+
+	ThreadPool(size_t numThreads = std::thread::hardware_concurrency())
+		: stopping(false), queued(0)
+	{
+		if (numThreads == 0)
+		{
+			numThreads = 1;
+		}
+
+		/* The last queue is the one for submitters outside the pool */
+		for (size_t i = 0; i <= numThreads; i++)
+		{
+			queues.push_back(std::make_unique<Queue>());
+		}
+
+		for (size_t i = 0; i < numThreads; i++)
+		{
+			threads.emplace_back([this, i] { workerLoop(i); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (auto& thread: threads)
+		{
+			thread.join();
+		}
+	}
+
+	void run(TaskGroup& group, std::function<void()> fn)
+	{
+		group.pending++;
+
+		auto& queue = *queues[self.pool == this ? self.index : threads.size()];
+		{
+			/* Counted under the lock that takeFrom() uncounts it under, so
+			 * queued can't drop below zero */
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back({std::move(fn), &group});
+			queued++;
+		}
+
+		group.posted.fetch_add(1, std::memory_order_release);
+		group.notify();
+
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	/* Returns once every task of group has finished, running them itself
+	 * where no worker has picked them up yet. Then rethrows the first
+	 * exception a task threw, if any did. */
+	void wait(TaskGroup& group)
+	{
+		Task task;
+		while (true)
+		{
+			uint64_t posted = group.posted.load(std::memory_order_acquire);
+
+			if (group.pending.load(std::memory_order_acquire) == 0)
+			{
+				break;
+			}
+
+			if (take(task, &group))
+			{
+				execute(task);
+				continue;
+			}
+
+			/* The rest runs on workers, or is about to be queued */
+			std::unique_lock<std::mutex> lock(group.mutex);
+			group.done.wait(lock, [&group, posted] {
+				return group.pending.load(std::memory_order_acquire) == 0
+						|| group.posted.load(std::memory_order_acquire) != posted;
+			});
+		}
+
+		/* The last task may still be in finish() */
+		{
+			std::lock_guard<std::mutex> lock(group.mutex);
+		}
+
+		/* Every task is done, nothing writes it anymore */
+		if (group.error)
+		{
+			std::exception_ptr error = std::move(group.error);
+			group.error = nullptr;
+
+			std::rethrow_exception(error);
+		}
+	}
+
+	/* Like wait(), but drops what the tasks threw: for a caller that's on its
+	 * way out with an exception of its own */
+	void drain(TaskGroup& group)
+	{
+		try
+		{
+			wait(group);
+		}
+		catch (...)
+		{ }
+	}
+
+	size_t size() const { return threads.size(); }
+
+private:
+	struct Task
+	{
+		std::function<void()> fn;
+		TaskGroup* group;
+	};
+
+	/* A vector rather than a deque: it holds a handful of tasks at most, and
+	 * a deque allocates and frees chunks as tasks go through it */
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Task> tasks;
+	};
+
+	struct Self
+	{
+		ThreadPool* pool;
+		size_t index;
+	};
+
+	void workerLoop(size_t index)
+	{
+		self = {this, index};
+
+		Task task;
+		while (true)
+		{
+			if (take(task, nullptr))
+			{
+				execute(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this] { return stopping || queued > 0; });
+
+			if (stopping)
+			{
+				return;
+			}
+		}
+	}
+
+	/* Takes a task (of group, if given): the newest one of our own, otherwise
+	 * the oldest one of anyone else */
+	bool take(Task& task, TaskGroup* group)
+	{
+		size_t own = self.pool == this ? self.index : queues.size();
+
+		if (own < queues.size() && takeFrom(*queues[own], task, group, false))
+		{
+			return true;
+		}
+
+		for (size_t i = 1; i <= queues.size(); i++)
+		{
+			size_t victim = (own + i) % queues.size();
+			if (victim != own && takeFrom(*queues[victim], task, group, true))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool takeFrom(Queue& queue, Task& task, TaskGroup* group, bool steal)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		auto matches = [group] (const Task& t) { return !group || t.group == group; };
+
+		if (steal)
+		{
+			for (auto it = queue.tasks.begin(); it != queue.tasks.end(); ++it)
+			{
+				if (matches(*it))
+				{
+					task = std::move(*it);
+					queue.tasks.erase(it);
+					queued--;
+					return true;
+				}
+			}
+		}
+		else
+		{
+			for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it)
+			{
+				if (matches(*it))
+				{
+					task = std::move(*it);
+					queue.tasks.erase(std::next(it).base());
+					queued--;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void execute(Task& task)
+	{
+		try
+		{
+			task.fn();
+		}
+		catch (...)
+		{
+			task.group->fail(std::current_exception());
+		}
+
+		task.group->finish();
+	}
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stopping;
+	std::atomic<size_t> queued;
+
+	static thread_local Self self;
+};
+
+inline thread_local ThreadPool::Self ThreadPool::self = {nullptr, 0};
+
+#endif /* THREADPOOL_H_ */